@@ -3,6 +3,7 @@
 #include "pin_config.h"
 #include "OneButton.h"
 #include "Wire.h"
+#include "wave_field.h"
 
 #define CTS328_SLAVE_ADDRESS (0x1A)
 #define CTS820_SLAVE_ADDRESS  (0X15)
@@ -20,472 +21,181 @@ TouchLib touch(Wire, PIN_IIC_SDA, PIN_IIC_SCL, CTS820_SLAVE_ADDRESS, PIN_TOUCH_R
 
 #define TOUCH_GET_FORM_INT 0
 
-#define WIDTH 320
-#define HEIGHT 170
-
-// Wave equation applies to pixels with pixelStatus values of NORMAL_PIXEL, ABSORBANT_PIXEL, GLASS_PIXEL
-#define NORMAL_PIXEL 0
-// ABSORBANT pixels have high damping on v
-#define ABSORBANT_PIXEL 1
-// GLASS pixels exhibit impedance by changing v less (with a lower proportionality constant)
-#define GLASS_PIXEL 2
-// WALL pixels stay fixed with zeroes in u and v, and a hardcoded 16-bit color value in image
-#define WALL_PIXEL 3
-// Remaining SOURCE types set u to various amplitudes
-#define LOW_FREQ_POS_SOURCE_PIXEL 4
-#define LOW_FREQ_NEG_SOURCE_PIXEL 5
-#define MID_FREQ_POS_SOURCE_PIXEL 6
-#define MID_FREQ_NEG_SOURCE_PIXEL 7
-#define HIGH_FREQ_POS_SOURCE_PIXEL 8
-#define HIGH_FREQ_NEG_SOURCE_PIXEL 9
-#define PHASED_ARRAY_SOURCE_PIXEL 10
-
-// 0.1 creates waves with ~16 px half wavelength:
-#define RADIANS_PER_ITERATION 0.1
-
-// For phased array pixels only:
-#define RADIANS_PER_PIXEL 0.15
-
-// Shifting right 2 bits (i.e. division by 4) implies a refractive index of sqrt(4) = 2.0
-#define GLASS_REFRACTION_BIT_SHIFT 2
-
-// Using only half the available INT32 range to guard against overflow after addition operations
-#define MIN_RANGE -0x40000000
-#define MAX_RANGE 0x3FFFFFFF
-
-#define LOW_DAMPING_BIT_SHIFT 12
-#define HIGH_DAMPING_BIT_SHIFT 5
-
-#define TOUCH_ONLY_MODE 0
-#define RANDOM_POINTS_MODE 1
-#define RANDOM_POINTS_ABSORBER_MODE 2
-#define RANDOM_POINTS_MULTIFREQUENCY_MODE 3
-#define RANDOM_POINTS_MULTIFREQUENCY_ABSORBER_MODE 4
-#define MONOPOLE_MODE 5
-#define MONOPOLE_ABSORBER_MODE 6
-#define DIPOLE_MODE 7
-#define DIPOLE_ABSORBER_MODE 8
-#define QUADRUPOLE_MODE 9
-#define QUADRUPOLE_ABSORBER_MODE 10
-#define SUPERPOSITION_MODE 11
-#define FLAT_MIRROR_MODE 12
-#define PARABOLIC_MIRROR_MODE 13
-#define ELLIPTIC_MIRROR_MODE 14
-#define REFRACTION_MODE 15
-#define PRISM_MODE 16
-#define LENS_MODE 17
-#define PARTIAL_INTERNAL_REFLECTION_MODE 18
-#define TOTAL_INTERNAL_REFLECTION_MODE 19
-#define FIBER_OPTIC_MODE 20
-#define WAVEGUIDE_MODE 21
-#define PHASED_ARRAY_MODE 22
-#define DOUBLE_SLIT_DIFFRACTION_MODE 23
-#define DIFFRACTION_GRATING_MODE 24
-#define MAZE_MODE 25
-
-#define TOTAL_MODES_COUNT 26
-
-#define RED_BLUE_SCALE 0
-#define YELLOW_PURPLE_SCALE 1
-#define RED_GREEN_SCALE 2
-#define YELLOW_CYAN_SCALE 3
-#define BLUE_GREEN_SCALE 4
-#define CYAN_PURPLE_SCALE 5
-
-#define TOTAL_SCALE_COUNT 6
+// Number of steps averaged for each step time report over Serial
+#define STEP_TIMING_INTERVAL 100
+
+// 1 to time the step at boot with the big buffers placed by each policy in turn (see placementPolicy), reporting over Serial; 0 to skip it
+#define PLACEMENT_BENCHMARK 0
+
+// Number of steps timed for each placement policy, after as many again to fill the field with waves
+#define PLACEMENT_BENCHMARK_STEPS 200
+
+// Number of simulation steps per displayed frame, only the last of which fills in the image array; 0 to pick the number automatically
+// so that waves cross the screen at TARGET_WAVE_SPEED
+#define SOLVER_SUBSTEPS 0
+
+// Wave speed in pixels per second aimed for when SOLVER_SUBSTEPS is 0
+#define TARGET_WAVE_SPEED 60
+
+// Upper limit on the number of steps per displayed frame when SOLVER_SUBSTEPS is 0
+#define MAX_SOLVER_SUBSTEPS 8
+
+// Size in pixels of each simulated cell in the reduced resolution mode, toggled by pressing the left button while holding down the right one
+#define REDUCED_RESOLUTION_SCALE 2
+
+// 1 to adjust the number of steps per frame, the resolution, and how often the HUD is redrawn so as to hold GOVERNOR_TARGET_FPS; 0 to leave them alone
+#define QUALITY_GOVERNOR 1
+
+// Frame rate the quality governor aims for
+#define GOVERNOR_TARGET_FPS 15
+
+// Number of frames averaged before each decision of the quality governor
+#define GOVERNOR_WINDOW 16
+
+// Quality is only raised again once the frame rate is this fraction above the target, so the governor does not flip back and forth
+#define GOVERNOR_HEADROOM 0.25
+
+// Largest number of frames between redraws of the HUD text
+#define MAX_HUD_INTERVAL 4
+
+// Number of governor decisions the reduced resolution is kept for before the governor tries full resolution again. Each time full
+// resolution is too slow from the moment it is restored, the wait doubles, up to GOVERNOR_MAX_RESOLUTION_HOLD, so a mode whose frame
+// rate sits between the two thresholds is not reset over and over
+#define GOVERNOR_RESOLUTION_HOLD 4
+#define GOVERNOR_MAX_RESOLUTION_HOLD 64
+
+// Most steps per frame the quality governor allows: the fixed SOLVER_SUBSTEPS, or MAX_SOLVER_SUBSTEPS when it is 0
+#define GOVERNOR_MAX_SUBSTEPS (SOLVER_SUBSTEPS > 0 ? SOLVER_SUBSTEPS : MAX_SOLVER_SUBSTEPS)
+
+// The HUD text covers the rows above HUD_TOP_HEIGHT and from HUD_BOTTOM_ROW down
+#define HUD_TOP_HEIGHT 16
+#define HUD_BOTTOM_ROW (HEIGHT - 15)
+
+// The intro text covers the rows from INTRO_TOP_ROW up to INTRO_BOTTOM_ROW
+#define INTRO_TOP_ROW 60
+#define INTRO_BOTTOM_ROW 106
+
+// Number of rows the HUD text covers
+#define HUD_ROWS (HUD_TOP_HEIGHT + HEIGHT - HUD_BOTTOM_ROW)
+
+const char *placementNames[TOTAL_PLACEMENT_COUNT] = { "planned", "PSRAM only", "malloc" };
+const char *regionNames[3] = { "internal RAM", "PSRAM", "host RAM" };
+
+const char *viewNames[TOTAL_VIEW_COUNT] = { "Showing amplitude", "Showing time averaged intensity", "Showing shaded surface" };
 
 uint8_t button_1_state = 0, button_2_state = 0, prev_button_1_state = 0, prev_button_2_state = 0;
 
 TFT_eSPI tft = TFT_eSPI();
 TFT_eSprite sprite = TFT_eSprite(&tft);
 
-// Array of current wave amplitudes and their first partial derivatives with respect to time
-int32_t *u, *v;
-// Array indicating pixel types (NORMAL_PIXEL, WALL_PIXEL, ABSORBANT_PIXEL, GLASS_PIXEL, etc.)
-uint8_t *pixelType;
-// Array for a full-screen image, 16-bit color encoding
-uint16_t *image;
+uint64_t startTime = esp_timer_get_time();
 
-uint8_t normalDampingBitShift = LOW_DAMPING_BIT_SHIFT;
-uint8_t absorbantDampingBitShift = HIGH_DAMPING_BIT_SHIFT;
+uint64_t timestamp = 0;
 
-uint32_t loopCounter = 0;
-uint64_t startTime = esp_timer_get_time();
+uint64_t stepMicros = 0;
+uint32_t stepCount = 0;
 
-uint8_t mode;
-uint8_t colorScale;
-String label = "";
+// Number of simulation steps per displayed frame
+int substeps = SOLVER_SUBSTEPS > 0 ? SOLVER_SUBSTEPS : 1;
 
-uint64_t timestamp = 0;
+// Quality settings chosen by the quality governor: the most steps allowed per frame, and the number of frames between redraws of the HUD text
+int substepLimit = GOVERNOR_MAX_SUBSTEPS;
+int hudInterval = 1;
+
+// Governor decisions since the resolution last changed, the number to wait before restoring full resolution, and whether the
+// governor has restored it without a frame rate on target since, so that it can tell when a restore has failed
+int resolutionAge = 0;
+int resolutionHold = GOVERNOR_RESOLUTION_HOLD;
+bool resolutionRestored = false;
+
+// Frame times collected for the quality governor's next decision; governorTimestamp is 0 while the frame in progress is not to be counted
+uint64_t governorMicros = 0;
+int governorFrames = 0;
+uint64_t governorTimestamp = 0;
+uint32_t frameCount = 0;
+
+// The step draws straight into the sprite, so the text drawn over it is only there for the frame it is pushed with. fieldRows holds
+// the pixels of the field under the text until they are put back, and hudRows holds the rows covered by the HUD as they were last
+// drawn with the text, for the frames that do not redraw it
+uint16_t *fieldRows = NULL;
+uint16_t *hudRows = NULL;
 
 bool touchEnabled = false;
 int lastTouchI = -1, lastTouchJ = -1;
 int touchPolarity = 1;
 bool touched = 0;
 
-int32_t applyCap(int32_t x) {
-  if (x < MIN_RANGE) {
-    return MIN_RANGE;
-  }
-  if (x > MAX_RANGE) {
-    return MAX_RANGE;
+/*
+ * Reports over Serial where each of the big buffers went, and how much internal RAM and PSRAM is left.
+ */
+void reportMemoryPlan() {
+  Serial.println("Buffer placement (" + String(placementNames[placementPolicy]) + "):");
+  for (int b = 0; b < bufferPlacementCount; b++) {
+    BufferPlacement &placement = bufferPlacements[b];
+    Serial.println("  " + String(placement.name) + ": " + String(placement.bytes) + " bytes in " + regionNames[placement.region]);
   }
-  return x;
+  Serial.println("Free internal RAM: " + String(ESP.getFreeHeap()) + " bytes, free PSRAM: " + String(ESP.getFreePsram()) + " bytes");
 }
 
 /*
- * Given row i, column j returns index into u, v, pixelType, and image arrays.
- * Used extensively from within clearField(), initalizeField(), and when processing touch events;
- * avoided elsewhere because it does multiplication.
+ * Reports over Serial which buffer setGridSize() could not allocate, and how much memory it needed.
  */
-int toIndex(int i, int j) {
-  return (i * WIDTH) + j;
+void reportAllocationFailure() {
+  Serial.println("Not enough memory for the field: " + String(allocationFailure.name) + " needs " + String(allocationFailure.bytes) + " bytes with "
+    + placementNames[placementPolicy] + " placement");
+  reportMemoryPlan();
 }
 
 /*
- * Used extensively from within initializeField().
- * Sets values in pixelStatus array to WALL_PIXEL along edges, ABSORBANT_PIXEL within specified padding regions, and NORMAL_PIXEL everywhere else.
+ * Shows message on the screen and over Serial and stops there, for when the simulation cannot run at all.
  */
-void clearField(int northPadding, int eastPadding, int southPadding, int westPadding) {
-  for (int i = 0; i < HEIGHT; i++) {
-    for (int j = 0; j < WIDTH; j++) {
-      int index = toIndex(i, j);
-      u[index] = v[index] = 0;
-      image[index] = 0;
-      pixelType[index] = NORMAL_PIXEL;
-      if (i < northPadding + 1 || j < westPadding + 1 || i >= HEIGHT - southPadding - 1 || j >= WIDTH - eastPadding - 1) {
-        pixelType[index] = ABSORBANT_PIXEL;
-      }
-      if (i == 0 || j == 0 || i == HEIGHT - 1 || j == WIDTH - 1) {
-        pixelType[index] = WALL_PIXEL;
-      }
-    }
+void halt(const String &message) {
+  Serial.println(message);
+  tft.fillScreen(TFT_BLACK);
+  tft.setTextColor(TFT_RED);
+  tft.drawString(message, 0, 0, 2);
+  for (;;) {
+    delay(1000);
   }
-  loopCounter = 0; // Reset phase of sine wave used for SOURCE type pixels
 }
 
+#if PLACEMENT_BENCHMARK
 /*
- * Huge function that initializes values in pixelStatus array for any given mode; runs only on startup and when the mode is updated.
+ * Times PLACEMENT_BENCHMARK_STEPS rendered steps of MONOPOLE_MODE with the big buffers placed by each policy in turn, then goes back
+ * to PLANNED_PLACEMENT. Every step is rendered, as the last step of each frame is, so the image is written as well as u and v.
  */
-void initializeField() {
-
-  int centerI = HEIGHT >> 1;
-  int centerJ = WIDTH >> 1;
-  clearField(0, 0, 0, 0);
-  label = "";
-
-  switch(mode) {
-    case TOUCH_ONLY_MODE:
-      label = "TOUCH ONLY";
-      break;
-    case RANDOM_POINTS_ABSORBER_MODE:
-      label = " (ABSORBING BOUNDARY)";
-      clearField(15, 15, 15, 15); // fall through
-    case RANDOM_POINTS_MODE:
-      for (int point = 0; point < 6; point++) {
-        pixelType[toIndex(random(30, HEIGHT - 30), random(30, WIDTH - 30))] = point % 2 ? MID_FREQ_POS_SOURCE_PIXEL : MID_FREQ_NEG_SOURCE_PIXEL;
-      }
-      label = "RANDOM POINTS" + label;
-      break;
-    case RANDOM_POINTS_MULTIFREQUENCY_ABSORBER_MODE:
-      label = " (ABSORBING BOUNDARY)";
-      clearField(15, 15, 15, 15); // fall through
-    case RANDOM_POINTS_MULTIFREQUENCY_MODE:
-      pixelType[toIndex(random(30, HEIGHT - 30), random(30, WIDTH - 30))] = MID_FREQ_POS_SOURCE_PIXEL;
-      pixelType[toIndex(random(30, HEIGHT - 30), random(30, WIDTH - 30))] = MID_FREQ_NEG_SOURCE_PIXEL;
-      pixelType[toIndex(random(30, HEIGHT - 30), random(30, WIDTH - 30))] = HIGH_FREQ_POS_SOURCE_PIXEL;
-      pixelType[toIndex(random(30, HEIGHT - 30), random(30, WIDTH - 30))] = HIGH_FREQ_NEG_SOURCE_PIXEL;
-      pixelType[toIndex(random(30, HEIGHT - 30), random(30, WIDTH - 30))] = LOW_FREQ_POS_SOURCE_PIXEL;
-      pixelType[toIndex(random(30, HEIGHT - 30), random(30, WIDTH - 30))] = LOW_FREQ_NEG_SOURCE_PIXEL;
-      label = "MULTIFREQUENCY POINTS" + label;
-      break;
-    case MONOPOLE_ABSORBER_MODE:
-      label = " (ABSORBING BOUNDARY)";
-      clearField(15, 15, 15, 15); // fall through
-    case MONOPOLE_MODE:
-      pixelType[toIndex(centerI, centerJ)] = MID_FREQ_POS_SOURCE_PIXEL;
-      label = "MONOPOLE" + label;
-      break;
-    case DIPOLE_ABSORBER_MODE:
-      label = " (ABSORBING BOUNDARY)";
-      clearField(15, 15, 15, 15); // fall through
-    case DIPOLE_MODE:
-      pixelType[toIndex(centerI, centerJ) - 10] = MID_FREQ_NEG_SOURCE_PIXEL;
-      pixelType[toIndex(centerI, centerJ) + 10] = MID_FREQ_POS_SOURCE_PIXEL;
-      label = "DIPOLE" + label;
-      break;
-    case QUADRUPOLE_ABSORBER_MODE:
-      label = " (ABSORBING BOUNDARY)";
-      clearField(15, 15, 15, 15); // fall through
-    case QUADRUPOLE_MODE:
-      pixelType[toIndex(centerI - 10, centerJ) - 10] = MID_FREQ_POS_SOURCE_PIXEL;
-      pixelType[toIndex(centerI + 10, centerJ) - 10] = MID_FREQ_NEG_SOURCE_PIXEL;
-      pixelType[toIndex(centerI + 10, centerJ) + 10] = MID_FREQ_POS_SOURCE_PIXEL;
-      pixelType[toIndex(centerI - 10, centerJ) + 10] = MID_FREQ_NEG_SOURCE_PIXEL;      
-      label = "QUADRUPOLE" + label;
-      break;
-    case SUPERPOSITION_MODE: {
-      int padding = 30;
-      clearField(padding, padding, padding, padding);
-      int halfWidth = 10;
-      int left = 100;
-      int top = 60;
-      int guideLength = 30;
-
-      for (int j = 1; j < guideLength; j++) {
-        pixelType[toIndex(top, j)] = WALL_PIXEL;
-        pixelType[toIndex(top + 4 * halfWidth, j)] = WALL_PIXEL;
-        for (int i = top + 1; i < top + 4 * halfWidth; i++) {
-          pixelType[toIndex(i, 1)] = LOW_FREQ_POS_SOURCE_PIXEL;
-          for (int j = 2; j <= padding; j++) {
-            pixelType[toIndex(i, j)] = NORMAL_PIXEL;
-          }
-        }
-      }
-      for (int i = 1; i < guideLength; i++) {
-        pixelType[toIndex(i, left)] = WALL_PIXEL;
-        pixelType[toIndex(i, left + halfWidth)] = WALL_PIXEL;
-        for (int j = left + 1; j < left + halfWidth; j++) {
-          pixelType[toIndex(1, j)] = HIGH_FREQ_POS_SOURCE_PIXEL;
-          for (int i = 2; i <= padding; i++) {
-            pixelType[toIndex(i, j)] = NORMAL_PIXEL;
-          }
-        }
-      }
-      label = "SUPERPOSITION";
-      break;
-    }
-    case FLAT_MIRROR_MODE:
-      clearField(25, 25, 25, 0);
-      for (int i = 25; i < HEIGHT - 25; i++) {
-        pixelType[toIndex(i, 1)] = MID_FREQ_POS_SOURCE_PIXEL;
-      }
-      for (int i = 50; i < HEIGHT - 50; i++) {
-        pixelType[toIndex(i, 1.5 * i)] = WALL_PIXEL;
-      }
-      label = "FLAT MIRROR";
-      break;
-    case PARABOLIC_MIRROR_MODE:
-      /* sideways version:
-      clearField(30, 10, 0, 10);
-      for (int i = 1; i < HEIGHT - 1; i++) {
-        int j = (i - centerI) * (i - centerI) >> 5;
-        j += j >> 1;
-        for (int k = 0; k < 8; k++) {
-          pixelType[toIndex(i, j + k)] = WALL_PIXEL;
-        }
-      }
-      pixelType[toIndex(centerI, 15)] = HIGH_FREQ_POS_SOURCE_PIXEL;
-      */
-      clearField(40, 0, 0, 0);
-      for (int j = 0; j <= centerJ; j++) {
-        int y = (j * j) / 150;
-        pixelType[toIndex(HEIGHT - y, centerJ - j)] = WALL_PIXEL;
-        pixelType[toIndex(HEIGHT - y, centerJ + j)] = WALL_PIXEL;
-      }
-      for (int j = 10; j < WIDTH - 10; j++) {
-        pixelType[toIndex(0, j)] = HIGH_FREQ_POS_SOURCE_PIXEL;
-      }
-      label = "PARABOLIC MIRROR";
-      break;
-    case ELLIPTIC_MIRROR_MODE: {
-      int a = centerJ;
-      int b = centerI;
-      for (int i = 0; i < HEIGHT; i++) {
-        for (int j = 0; j < WIDTH; j++) {
-          int x = j - a;
-          int y = i - b;
-          int rangeFactor = (x * x * b * b) + (a * a * y * y) - ( a * a * b * b);
-          if (rangeFactor >= 0 && rangeFactor < 10000000) {
-            pixelType[toIndex(i, j)] = WALL_PIXEL;
-          }
-        }
-      }
-      pixelType[toIndex(b, 25)] = HIGH_FREQ_POS_SOURCE_PIXEL;
-      label = "ELLIPTIC MIRROR";
-      break;
+void benchmarkPlacements() {
+  for (uint8_t policy = 0; policy < TOTAL_PLACEMENT_COUNT; policy++) {
+    placementPolicy = policy;
+    if (!setGridSize(WIDTH, HEIGHT)) {
+      reportAllocationFailure();
+      continue;
     }
-    case REFRACTION_MODE:
-      clearField(20, 20, 20, 20);
-      for (int i = 25; i < HEIGHT - 25; i++) {
-        for (int j = centerJ - 30; j <= centerJ + 30; j++) {
-          pixelType[toIndex(i, j)] = GLASS_PIXEL;
-        }
-        if (i > 100) {
-          pixelType[toIndex(i, i - 17)] = MID_FREQ_POS_SOURCE_PIXEL;
-        }
-      }
-      label = "REFRACTION";
-      break;
-    case PRISM_MODE: {
-      clearField(20, 20, 20, 20);
-      for (int i = 20; i < 150; i++) {
-        int prismHalfWidth = (i - 20) * 75 / 130;
-        for (int j = centerJ - prismHalfWidth; j <= centerJ + prismHalfWidth; j++) {
-          pixelType[toIndex(i, j)] = GLASS_PIXEL;
-        }
-      }
-
-      for (int i = centerI; i < HEIGHT - 20; i++) {
-        if (i > 130) {
-          pixelType[toIndex(i, (i - 70))] = MID_FREQ_POS_SOURCE_PIXEL;
-        }
-      }
-      label = "PRISM";
-      break;
-    }
-    case LENS_MODE: {
-      clearField(20, 30, 20, 30);
-      int maxRadiusSquared = (centerJ + 100) * (centerJ + 100);
-      int leftRadialFocusHorizontalPosition = -140;
-      int rightRadialFocusHorizontalPosition = WIDTH + 40;
-      for (int i = 21; i < HEIGHT - 21; i++) {
-        pixelType[toIndex(i, 0)] = HIGH_FREQ_POS_SOURCE_PIXEL;
-        for (int j = 22; j < WIDTH - 21; j++) {
-          if (((centerI - i) * (centerI - i)) + ((leftRadialFocusHorizontalPosition - j) * (leftRadialFocusHorizontalPosition - j)) < maxRadiusSquared) {
-            if (((centerI - i) * (centerI - i)) + ((rightRadialFocusHorizontalPosition - j) * (rightRadialFocusHorizontalPosition - j))  < maxRadiusSquared) {
-              pixelType[toIndex(i, j)] = GLASS_PIXEL;
-            }
-          }
-        }
-      }
-      label = "LENS";
-      break;
-    }
-    case PARTIAL_INTERNAL_REFLECTION_MODE:
-      clearField(20, 20, 20, 10);
-      for (int i = centerI; i < HEIGHT - 20; i++) {
-        for (int j = 1; j < WIDTH - 18; j++) {
-          pixelType[toIndex(i, j)] = GLASS_PIXEL;
-        }
-        if (i > 100) {
-          pixelType[toIndex(i, (i - 100) << 1)] = MID_FREQ_POS_SOURCE_PIXEL;
-          for (int j = 1; j < (i - 100) << 1; j++) {
-            pixelType[toIndex(i, j)] = ABSORBANT_PIXEL;
-          }
-        }
-      }
-      label = "PARTIAL INTERNAL REFLECTION";
-      break;
-    case TOTAL_INTERNAL_REFLECTION_MODE:
-      clearField(20, 20, 20, 20);
-      for (int i = centerI; i < HEIGHT - 20; i++) {
-        for (int j = 1; j < WIDTH - 18; j++) {
-          pixelType[toIndex(i, j)] = GLASS_PIXEL;
-        }
-        if (i > 100) {
-          pixelType[toIndex(i, (i - 100) >> 1)] = MID_FREQ_POS_SOURCE_PIXEL;
-          for (int j = 1; j < ((i - 100) >> 1); j++) {
-            pixelType[toIndex(i, j)] = ABSORBANT_PIXEL;
-          }
-        }
-      }
-      label = "TOTAL INTERNAL REFLECTION";
-      break;
-    case FIBER_OPTIC_MODE: {
-      clearField(0, 40, 0, 10);
-
-      int topCenter = 40;
-      for (int i = topCenter - 15; i <= topCenter + 15; i++) {
-        for (int j = 2; j < WIDTH - 41; j++) {
-          pixelType[toIndex(i, j)] = GLASS_PIXEL;
-        }
-      }
-      for (int i = topCenter - 13; i <= topCenter + 13; i++) {
-        pixelType[toIndex(i, 1)] = LOW_FREQ_POS_SOURCE_PIXEL;
-      }
-
-      int middleCenter = centerI + 25;
-      for (int i = middleCenter - 8; i <= middleCenter + 8; i++) {
-        for (int j = 2; j < WIDTH - 41; j++) {
-          pixelType[toIndex(i, j)] = GLASS_PIXEL;
-        }
-      }
-      for (int i = middleCenter - 6; i <= middleCenter + 6; i++) {
-        pixelType[toIndex(i, 1)] = MID_FREQ_POS_SOURCE_PIXEL;
-      }
-
-      int bottomCenter = HEIGHT - 20;
-      for (int i = bottomCenter - 4; i <= bottomCenter + 4; i++) {
-        for (int j = 2; j < WIDTH - 41; j++) {
-          pixelType[toIndex(i, j)] = GLASS_PIXEL;
-        }
-      }
-      for (int i = bottomCenter - 3; i <= bottomCenter + 3; i++) {
-        pixelType[toIndex(i, 1)] = HIGH_FREQ_POS_SOURCE_PIXEL;
-      }      
-      label = "FIBER OPTIC CABLES";
-      break;
-    }
-    case WAVEGUIDE_MODE: {
-      clearField(15, 15, 15, 15);
-      int halfWidth = 25;
-      for (int j = 1; j < centerJ; j++) {
-        pixelType[toIndex(centerI - halfWidth, j)] = WALL_PIXEL;
-        pixelType[toIndex(centerI + halfWidth, j)] = WALL_PIXEL;
-      }
-      for (int i = centerI - halfWidth + 1; i < centerI + halfWidth - 1; i++) {
-        pixelType[toIndex(i, 1)] = i > centerI ? MID_FREQ_POS_SOURCE_PIXEL : MID_FREQ_NEG_SOURCE_PIXEL;
-        for (int j = 2; j <= 15; j++) {
-          pixelType[toIndex(i, j)] = NORMAL_PIXEL;
-        }
-      }
-      label = "WAVEGUIDE";
-      break;
-    }
-    case PHASED_ARRAY_MODE:
-      clearField(15, 15, 15, 15);
-      for (int j = centerJ - 100; j < centerJ + 100; j++) {
-        pixelType[toIndex(centerI, j)] = PHASED_ARRAY_SOURCE_PIXEL;
-      }
-      label = "PHASED ARRAY";
-      break;
-    case DOUBLE_SLIT_DIFFRACTION_MODE: {
-      clearField(20, 20, 0, 20);
-      int halfSlitWidth = 10;
-      for (int j = 0; j < WIDTH; j++) {
-        pixelType[toIndex(HEIGHT - 1, j)] = ((j > centerJ - halfSlitWidth && j < centerJ + halfSlitWidth)
-          || (j < centerJ - (3 * halfSlitWidth))
-          || (j > centerJ + (3 * halfSlitWidth)))
-          ? WALL_PIXEL : MID_FREQ_POS_SOURCE_PIXEL;
-      }
-      label = "DOUBLE SLIT DIFFRACTION";
-      break;
-    }
-    case DIFFRACTION_GRATING_MODE:
-      clearField(25, 20, 0, 20);
-      for (int j = 1; j < WIDTH - 1; j++) {
-        if (j > 110 && j < WIDTH - 110 && (j % 20 < 5 || j % 20 > 15)) {
-          pixelType[toIndex(HEIGHT - 1, j)] = HIGH_FREQ_POS_SOURCE_PIXEL;
-        }
-      }
-      label = "DIFFRACTION GRATING";
-      break;
-    case MAZE_MODE: {
-      bool leftward = true;
-      for (int i = HEIGHT / 5; i < HEIGHT; i += HEIGHT / 5) {
-        if (leftward) {
-          for (int j = 0; j < WIDTH - (HEIGHT / 5); j++) {
-            pixelType[toIndex(i, j)] = WALL_PIXEL;
-          }
-        } else {
-          for (int j = HEIGHT / 5; j < WIDTH; j++) {
-            pixelType[toIndex(i, j)] = WALL_PIXEL;
-          }
-        }
-        leftward = !leftward;
-      }
-      for (int j = 1; j < (HEIGHT / 5) - 1; j++) {
-        pixelType[toIndex(j, 1)] = MID_FREQ_POS_SOURCE_PIXEL;
-      }
-      label = "MAZE";
-      break;
+    mode = MONOPOLE_MODE;
+    initializeField();
+    uint64_t start = 0;
+    for (int step = 0; step < 2 * PLACEMENT_BENCHMARK_STEPS; step++) {
+      if (step == PLACEMENT_BENCHMARK_STEPS) {
+        start = esp_timer_get_time();
+      }
+#if FUSED_WAVE_STEP
+      stepFieldFused(true);
+#else
+      stepFieldTwoPass();
+#endif
+      loopCounter++;
     }
-    default:
-      label = "";
-      break;
+    uint32_t micros = (esp_timer_get_time() - start) / PLACEMENT_BENCHMARK_STEPS;
+    reportMemoryPlan();
+    Serial.println("Step time with " + String(placementNames[policy]) + " placement: " + String(micros) + " us");
+  }
+  placementPolicy = PLANNED_PLACEMENT;
+  if (!setGridSize(WIDTH, HEIGHT)) {
+    reportAllocationFailure();
+    halt("Not enough memory for the " + String(allocationFailure.name));
   }
 }
+#endif
 
 void setup() {
 
@@ -519,14 +229,30 @@ void setup() {
   tft.setRotation(1);
   sprite.createSprite(WIDTH, HEIGHT);
   sprite.setTextColor(TFT_GREEN);
+  fieldRows = (uint16_t*)calloc((HUD_ROWS + INTRO_BOTTOM_ROW - INTRO_TOP_ROW) * WIDTH, sizeof(uint16_t));
+  hudRows = (uint16_t*)calloc(HUD_ROWS * WIDTH, sizeof(uint16_t));
+  if (fieldRows == NULL || hudRows == NULL) {
+    halt("Not enough memory for the HUD rows");
+  }
 
-  // Allocate arrays: pixelType, u, v, and image
-  pixelType = (uint8_t*)malloc(WIDTH * HEIGHT);
+  // Allocate arrays for a grid the size of the screen: pixelType, u, and v, with the image drawn straight into the sprite.
+  // Its colors are already in the byte order the sprite keeps them in
+  if (sprite.getPointer() == NULL) {
+    halt("Not enough memory for the sprite");
+  }
+  setImageBuffer((uint16_t*)sprite.getPointer());
+  if (!setGridSize(WIDTH, HEIGHT)) {
+    reportAllocationFailure();
+    halt("Not enough memory for the " + String(allocationFailure.name));
+  }
 
-  u = (int32_t*)malloc(WIDTH * HEIGHT * 4);
-  v = (int32_t*)malloc(WIDTH * HEIGHT * 4);
+  // Split the field into bands stepped in parallel on both cores
+  startSolverBands(SOLVER_BANDS);
 
-  image = (uint16_t*)malloc(WIDTH * HEIGHT * 2);
+#if PLACEMENT_BENCHMARK
+  benchmarkPlacements();
+#endif
+  reportMemoryPlan();
 
   // Initialize mode value, startTime, and pixelType array:
   mode = touchEnabled ? TOUCH_ONLY_MODE : RANDOM_POINTS_MODE;
@@ -535,14 +261,116 @@ void setup() {
   colorScale = RED_BLUE_SCALE;
 }
 
+/*
+ * Copies rows firstRow up to but not including lastRow of the image into buffer, or from buffer back into the image if restore is set.
+ * Returns the end of the rows in buffer, where the next rows can go.
+ */
+uint16_t *copyRows(uint16_t *buffer, int firstRow, int lastRow, bool restore) {
+  size_t bytes = (lastRow - firstRow) * WIDTH * sizeof(uint16_t);
+  if (restore) {
+    memcpy(image + firstRow * WIDTH, buffer, bytes);
+  } else {
+    memcpy(buffer, image + firstRow * WIDTH, bytes);
+  }
+  return buffer + (lastRow - firstRow) * WIDTH;
+}
+
+/*
+ * Copies the rows the HUD text covers into buffer, or from buffer back into the image if restore is set, and returns the end of them in buffer.
+ */
+uint16_t *copyHudRows(uint16_t *buffer, bool restore) {
+  return copyRows(copyRows(buffer, 0, HUD_TOP_HEIGHT, restore), HUD_BOTTOM_ROW, HEIGHT, restore);
+}
+
+/*
+ * Switches between full and reduced resolution and resets the field; used by the buttons and by the quality governor. Returns false,
+ * leaving the field running at its current resolution, if there is not enough memory for the other one.
+ */
+bool toggleResolution() {
+  if (!setFieldScale(fieldScale == 1 ? REDUCED_RESOLUTION_SCALE : 1)) {
+    Serial.println("Not enough memory for the " + String(allocationFailure.name) + " at the other resolution: " + String(allocationFailure.bytes)
+      + " bytes");
+    return false;
+  }
+  resolutionAge = 0;
+  Serial.println("Simulating " + String(fieldWidth) + " x " + String(fieldHeight) + " cells");
+  lastTouchI = -1;
+  lastTouchJ = -1;
+  startTime = esp_timer_get_time();
+  timestamp = startTime;
+  initializeField();
+  return true;
+}
+
+/*
+ * Quality governor: averages the frame time over GOVERNOR_WINDOW frames, then lowers or raises one quality setting at a time to hold
+ * GOVERNOR_TARGET_FPS. When frames are too slow, the HUD is redrawn less often first, then fewer steps are run per frame,
+ * and as a last resort the simulation drops to reduced resolution. Once there is headroom the settings are restored in the reverse order;
+ * full resolution needs enough headroom for the extra solver work, and is only tried again after resolutionHold decisions at reduced
+ * resolution, since each switch resets the field.
+ */
+void governQuality(uint64_t frameMicros) {
+  governorMicros += frameMicros;
+  if (++governorFrames < GOVERNOR_WINDOW) {
+    return;
+  }
+  double fps = 1000000.0 * governorFrames / governorMicros;
+  governorMicros = 0;
+  governorFrames = 0;
+  resolutionAge++;
+  if (resolutionRestored && fps >= GOVERNOR_TARGET_FPS) {
+    // Full resolution has held up, so the next drop starts with the shortest wait again
+    resolutionRestored = false;
+    resolutionHold = GOVERNOR_RESOLUTION_HOLD;
+  }
+
+  String decision = "";
+  if (fps < GOVERNOR_TARGET_FPS) {
+    if (hudInterval < MAX_HUD_INTERVAL) {
+      hudInterval++;
+      decision = "HUD redrawn every " + String(hudInterval) + " frames";
+    } else if (substepLimit > 1) {
+      substepLimit = (substeps < substepLimit ? substeps : substepLimit) - 1;
+      decision = "at most " + String(substepLimit) + " steps per frame";
+    } else if (fieldScale == 1 && toggleResolution()) {
+      if (resolutionRestored) {
+        resolutionHold = resolutionHold * 2 < GOVERNOR_MAX_RESOLUTION_HOLD ? resolutionHold * 2 : GOVERNOR_MAX_RESOLUTION_HOLD;
+        resolutionRestored = false;
+      }
+      decision = "reduced resolution for at least " + String(resolutionHold * GOVERNOR_WINDOW) + " frames";
+    }
+  } else if (fps > GOVERNOR_TARGET_FPS * (1 + GOVERNOR_HEADROOM)) {
+    if (fieldScale > 1 && resolutionAge > resolutionHold && fps > GOVERNOR_TARGET_FPS * REDUCED_RESOLUTION_SCALE && toggleResolution()) {
+      resolutionRestored = true;
+      decision = "full resolution";
+    } else if (substepLimit < GOVERNOR_MAX_SUBSTEPS && substeps >= substepLimit) {
+      substepLimit++;
+#if SOLVER_SUBSTEPS > 0
+      // Only the governor moves a fixed number of steps per frame, so it puts back the step it took away
+      substeps = substepLimit;
+#endif
+      decision = "at most " + String(substepLimit) + " steps per frame";
+    } else if (hudInterval > 1) {
+      hudInterval--;
+      decision = "HUD redrawn every " + String(hudInterval) + " frames";
+    }
+  }
+  if (decision.length() > 0) {
+    Serial.println("Governor: " + String(fps, 1) + " fps against " + String(GOVERNOR_TARGET_FPS) + " fps target, " + decision);
+  }
+}
+
 void loop() {
 
   // First: Check the buttons
   button_1_state = digitalRead(PIN_BUTTON_1);
   button_2_state = digitalRead(PIN_BUTTON_2);
 
-  // Button 1 advances the mode, advances the color scale, and resets the field.
-  if (button_1_state != prev_button_1_state) {
+  // Button 1 pressed while button 2 is held down switches between full and reduced resolution, and resets the field.
+  if (button_1_state != prev_button_1_state && button_1_state == LOW && button_2_state == LOW) {
+    toggleResolution();
+  } else if (button_1_state != prev_button_1_state) {
+    // Otherwise button 1 advances the mode, advances the color scale, and resets the field.
     if (button_1_state == LOW) {
       touched = true;
       mode++;
@@ -559,8 +387,16 @@ void loop() {
     } // else Serial.println("BUTTON 1 RELEASED");
   }
 
-  // Button 2 advances the color scale only, before resetting the field
-  if (button_2_state != prev_button_2_state) {
+  // Button 2 pressed while button 1 is held down moves on to the next view: u, its time averaged intensity, or u as a shaded surface.
+  // A view that cannot be shown, for want of memory, is skipped.
+  if (button_2_state != prev_button_2_state && button_2_state == LOW && button_1_state == LOW) {
+    uint8_t view = fieldView;
+    do {
+      view = (view + 1) % TOTAL_VIEW_COUNT;
+    } while (!setFieldView(view));
+    Serial.println(viewNames[fieldView]);
+  } else if (button_2_state != prev_button_2_state) {
+    // Otherwise button 2 advances the color scale only, before resetting the field
     if (button_2_state == LOW) {
       touched = true;
       colorScale++;
@@ -577,6 +413,7 @@ void loop() {
   prev_button_2_state = button_2_state;
   
   if (button_1_state == LOW || button_2_state == LOW) {
+    governorTimestamp = 0; // Time spent with a button held down is not counted by the quality governor
     delay(100); // Pro forma debounce (main loop already gives pin voltages enough time to stop ringing)
     return;
   }
@@ -593,9 +430,10 @@ void loop() {
     if (read) {
       touched = true;
       TP_Point t = touch.getPoint(0);
-      int i = HEIGHT - t.x;
-      int j = t.y;
-      v[toIndex(i, j)] = touchPolarity * MAX_RANGE >> 1;
+      // Screen coordinates are converted to cells of the field
+      int i = (HEIGHT - t.x) / fieldScale;
+      int j = t.y / fieldScale;
+      setVelocity(i, j, touchPolarity * MAX_RANGE >> 1);
       if (lastTouchI != -1 && lastTouchJ != -1) {
         // Clumsy loop to draw a line from lastTouchI, lastTouchJ to i, j
         double i_d = (double)i;
@@ -608,8 +446,8 @@ void loop() {
         for (int k = 0; k <= round(r); k++) {
           int i_index = round(i_d + delta_i * k);
           int j_index = round(j_d + delta_j * k);
-          // Set values in v to large values along the drag path
-          v[toIndex(i_index, j_index)] = touchPolarity * MAX_RANGE >> 1;
+          // Set large velocities along the drag path
+          setVelocity(i_index, j_index, touchPolarity * MAX_RANGE >> 1);
         }
       }
       lastTouchI = i;
@@ -623,129 +461,67 @@ void loop() {
     }
   }
 
-  // First CPU-intensive loop: update values in v based on values in u given the wave equation:
-  // d2u/dt2 = c * c * (d2x/dt2 + d2y/dt2) - k * du/dt
-  // where d2u/dt2 is second partial time derivative, d2u/dx2 and d2u/dy2 are second partial space derivatives with respect to x and y,
-  // c is constant wave speed through the medium (same for regions with NORMAL and ABSORBANT pixels, slower for areas with GLASS pixels),
-  // and k is a damping constant close to zero except in regions with pixels of type IMEPEDANCE_PIXEL.
-  for (int index = 0; index < HEIGHT * WIDTH; index++) {
-    uint8_t pixelStatus = pixelType[index];
-    if (pixelStatus == NORMAL_PIXEL || pixelStatus == ABSORBANT_PIXEL || pixelStatus == GLASS_PIXEL) {
-      // Wave equation applies to normal, absorbant, and glass pixels
-      int32_t uCen = u[index];
-      int32_t uNorth = u[index - WIDTH];
-      int32_t uSouth = u[index + WIDTH];
-      int32_t uEast = u[index + 1];
-      int32_t uWest = u[index - 1];
-      int32_t uxx = ((uWest + uEast) >> 1) - uCen;
-      int32_t uyy = ((uNorth + uSouth) >> 1) - uCen;
-      int32_t vel = v[index] + (uxx >> 1) + (uyy >> 1);
-      // Velocity is damped lightly for normal and glass pixels, heavily for absorbant pixels
-      vel -= (vel >> (pixelStatus == ABSORBANT_PIXEL ? absorbantDampingBitShift : normalDampingBitShift));
-      v[index] = applyCap(vel);
+  // Advance the simulation by the given number of steps, filling in the image array on the last of them only
+  for (int substep = 0; substep < substeps; substep++) {
+    uint64_t stepStart = esp_timer_get_time();
+#if FUSED_WAVE_STEP
+    stepFieldFused(substep == substeps - 1);
+#else
+    stepFieldTwoPass();
+#endif
+    stepMicros += esp_timer_get_time() - stepStart;
+    stepCount++;
+    if (stepCount == STEP_TIMING_INTERVAL) {
+      // Report average time spent in the simulation step, for comparing FUSED_WAVE_STEP against the two-pass version
+      Serial.println("Step time: " + String((uint32_t)(stepMicros / stepCount)) + " us, " + String(substeps) + " steps per frame");
+      stepMicros = 0;
+      stepCount = 0;
     }
-  }
-
-  // Second CPU-intensive loop: update each value in u based on its corresponding value in v given that v=du/dt, using one loop interval as dt,
-  // except for SOURCE pixels where we set u to their current amplitude. Then, calculate a 16-bit color value for image, based on the value in u.
-  int lowFrequencyAmplitude = (MAX_RANGE >> 1) * sin(0.5 * RADIANS_PER_ITERATION * loopCounter);
-  int midFrequencyAmplitude = (MAX_RANGE >> 1) * sin(RADIANS_PER_ITERATION * loopCounter);
-  int highFrequencyAmplitude = (MAX_RANGE >> 1) * sin(2 * RADIANS_PER_ITERATION * loopCounter);
-  for (int index = 0; index < HEIGHT * WIDTH; index++) {
-      uint8_t pixelStatus = pixelType[index];
-      // WALL_PIXEL: can be skipped (u = 0, v = 0).
-      if (pixelStatus == NORMAL_PIXEL || pixelStatus == ABSORBANT_PIXEL) {
-        // NORMAL_PIXEL and ABSORBANT_PIXEL: update u by adding an amount proportional to v. (Using loop interval as dt, proportionality constant is 1.0.)
-        u[index] = applyCap(u[index] + v[index]);
-      } else if (pixelStatus == GLASS_PIXEL) {
-        // GLASS_PIXEL: Using 2.0 as index of refraction for glass implies a wave speed of 0.5, so the proportionality constant is 0.25, obtainable by shifting right 2 bits.
-        u[index] = applyCap(u[index] + (v[index] >> GLASS_REFRACTION_BIT_SHIFT));
-      } else if (pixelType[index] == LOW_FREQ_POS_SOURCE_PIXEL) {
-        u[index] = lowFrequencyAmplitude;
-      } else if (pixelType[index] == LOW_FREQ_NEG_SOURCE_PIXEL) {
-        u[index] = -lowFrequencyAmplitude;
-      } else if (pixelType[index] == MID_FREQ_POS_SOURCE_PIXEL) {
-        u[index] = midFrequencyAmplitude;
-      } else if (pixelType[index] == MID_FREQ_NEG_SOURCE_PIXEL) {
-        u[index] = -midFrequencyAmplitude;
-      } else if (pixelType[index] == HIGH_FREQ_POS_SOURCE_PIXEL) {
-        u[index] = highFrequencyAmplitude;
-      } else if (pixelType[index] == HIGH_FREQ_NEG_SOURCE_PIXEL) {
-        u[index] = -highFrequencyAmplitude;
-      } else if (pixelType[index] == PHASED_ARRAY_SOURCE_PIXEL) {
-        // PHASED_ARRAY_MODE has a horizontal line of phased array pixels; they introduce a sinusoidal dependence on index (spatial variable)
-        u[index] = (MAX_RANGE >> 1) * sin( 0.5 * (RADIANS_PER_ITERATION * loopCounter - RADIANS_PER_PIXEL * index));
-      }
-
-      // Second part of loop body- select a 16-bit color to put in image array
-      if (pixelStatus == WALL_PIXEL) {
-        // Just use a light gray for WALL pixels (can use 0xffff for garish white)
-        image[index] = 2048 | 64 | 2;
-      } else {
-        // Have to actually calculate a color for anything that isn't a WALL_PIXEL, based on its value in u
-        bool isPositive = u[index] >= 0;
-        uint16_t val = (uint16_t)((isPositive ? u[index] : -u[index]) >> 23);
-        if (val > 63) {
-          val = 63;
-        }
-
-        // Standard 16-bit RGB565-encoded color values (e.g. TFT_GREEN, etc.) produce bizarre colors when planted directly into image array
-        // but this encoding seems to work
-        int red = ((val & 0xf8) << 2);
-        int green = val >> 3;
-        int blue = ((val & 0xfc) << 7);
-
-        switch(colorScale) {
-            case RED_BLUE_SCALE:
-              image[index] = isPositive ? red : blue;
-              break;
-            case YELLOW_PURPLE_SCALE:
-              image[index] = isPositive ? red | green : red | blue;
-              break;
-            case RED_GREEN_SCALE:
-              image[index] = isPositive ? red : green;
-              break;
-            case YELLOW_CYAN_SCALE:
-              image[index] = isPositive ? red | green : green | blue;
-              break;
-            case BLUE_GREEN_SCALE:
-              image[index] = isPositive ? green : blue;
-              break;
-            case CYAN_PURPLE_SCALE:
-              image[index] = isPositive ? green | blue : red | blue;
-              break;
-        }
 
-        // ABSORBANT_PIXEL and GLASS_PIXEL need some extra color bits set for visibility
-        if (pixelStatus == ABSORBANT_PIXEL) {
-          // For ABSORBANT_PIXEL increase red, green, blue saturation
-          image[index] |= 1024 | 32 | 1;
-        }
-        if (pixelStatus == GLASS_PIXEL) {
-          // For GLASS_PIXEL increase blue saturation only
-          image[index] |= 2048;
-        }
-      }
+    loopCounter++;
   }
 
-  loopCounter++;
-
-  // Push the image array into the sprite
-  sprite.pushImage(0, 0, WIDTH, HEIGHT, image);
-
   // Roughly calculate frames per second
   uint64_t new_timestamp = esp_timer_get_time();
   double duration = (double)((new_timestamp - timestamp) / 1000);
   uint8_t fps = round(1000 / duration);
 
-  if (label.length() > 0) {
+  bool introShowing = !touched && ((touchEnabled && mode == TOUCH_ONLY_MODE) || (!touchEnabled && mode == RANDOM_POINTS_MODE && new_timestamp - startTime < 10000000));
+  bool drawHud = label[0] != '\0' && (frameCount % hudInterval == 0 || introShowing);
+  frameCount++;
+
+  // The image array is the sprite. The HUD text is drawn over the top and bottom rows, so the field under them is set aside first,
+  // and on frames where the text is not redrawn those rows show it as it was last drawn, along with the field under it then
+  bool drawIntro = drawHud && timestamp > 0 && introShowing;
+  if (label[0] != '\0') {
+    uint16_t *intro = copyHudRows(fieldRows, false);
+    if (drawIntro) {
+      copyRows(intro, INTRO_TOP_ROW, INTRO_BOTTOM_ROW, false);
+    }
+    if (!drawHud) {
+      copyHudRows(hudRows, true);
+    }
+  }
+
+  if (drawHud) {
     // Draw strings on the sprite for label, current fps
     sprite.setTextSize(1);
     sprite.setTextColor(TFT_DARKGREY, TFT_BLACK);
     sprite.drawString(label, 0, 0, 2);
 
     if (timestamp > 0) {
-      sprite.drawString(String(fps) + " fps", 280, 155, 2);
+      sprite.drawString(String(fps) + " fps", WIDTH - 40, HUD_BOTTOM_ROW, 2);
+#if QUALITY_GOVERNOR
+      // Current quality settings: steps per frame, with the resolution and HUD redraw interval when they have been lowered
+      String quality = String(substeps) + "x";
+      if (fieldScale > 1) {
+        quality += " 1/" + String(fieldScale);
+      }
+      if (hudInterval > 1) {
+        quality += " H" + String(hudInterval);
+      }
+      sprite.drawString(quality, WIDTH - 120, HUD_BOTTOM_ROW, 2);
+#endif
 
       uint64_t total_microseconds = new_timestamp - startTime;
       uint64_t microsec = total_microseconds % 1000000;
@@ -760,30 +536,63 @@ void loop() {
 
       String seconds = String(sec);
       if(total_min < 1) {
-        sprite.drawString(seconds, 0, 155, 2); 
+        sprite.drawString(seconds, 0, HUD_BOTTOM_ROW, 2); 
       } else {
           while (seconds.length() < 2) {
             seconds = "0" + seconds;
           }
           String minutes = String(min);
           if (total_hrs < 1) {
-            sprite.drawString(minutes + ":" + seconds, 0, 155, 2);
+            sprite.drawString(minutes + ":" + seconds, 0, HUD_BOTTOM_ROW, 2);
           } else {
               while (minutes.length() < 2) {
                 minutes = "0" + minutes;
               }
-            sprite.drawString(String(total_hrs) + ":" + minutes + ":" + seconds, 0, 155, 2);
+            sprite.drawString(String(total_hrs) + ":" + minutes + ":" + seconds, 0, HUD_BOTTOM_ROW, 2);
           }
       }
-      if (!touched && ((touchEnabled && mode == TOUCH_ONLY_MODE) || (!touchEnabled && mode == RANDOM_POINTS_MODE && total_sec < 10))) {
+      if (drawIntro) {
         sprite.setTextColor(TFT_RED, TFT_BLACK);
-        sprite.drawString("WAVE EQUATION SIMULATOR", 70, 60, 2);
+        sprite.drawString("WAVE EQUATION SIMULATOR", 70, INTRO_TOP_ROW, 2);
         sprite.setTextColor(TFT_YELLOW, TFT_BLACK);
         sprite.drawString("https://github.com/jtiscione/TDisplayWave/", 25, 90, 2);
       }
     }
+    copyHudRows(hudRows, false);
   }
   sprite.pushSprite(0, 0);
+
+  // Put the field back under the text for the next step to draw over
+  if (label[0] != '\0') {
+    uint16_t *intro = copyHudRows(fieldRows, true);
+    if (drawIntro) {
+      copyRows(intro, INTRO_TOP_ROW, INTRO_BOTTOM_ROW, true);
+    }
+  }
+
+#if SOLVER_SUBSTEPS == 0
+  // Adjust the number of steps per frame towards TARGET_WAVE_SPEED, only dropping a step if the speed would stay on target without it
+  if (timestamp > 0 && new_timestamp > timestamp) {
+    double waveSpeed = substeps * WAVE_SPEED_PIXELS_PER_STEP * fieldScale * 1000000.0 / (new_timestamp - timestamp);
+    if (waveSpeed < TARGET_WAVE_SPEED && substeps < substepLimit) {
+      substeps++;
+    } else if (substeps > 1 && waveSpeed * (substeps - 1) / substeps >= TARGET_WAVE_SPEED) {
+      substeps--;
+    }
+  }
+#endif
+  if (substeps > substepLimit) {
+    substeps = substepLimit;
+  }
+
+#if QUALITY_GOVERNOR
+  uint64_t frameEnd = esp_timer_get_time();
+  if (governorTimestamp > 0) {
+    governQuality(frameEnd - governorTimestamp);
+  }
+  governorTimestamp = frameEnd;
+#endif
+
   timestamp = new_timestamp;
 
 }
\ No newline at end of file
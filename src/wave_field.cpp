@@ -0,0 +1,2412 @@
+#include "wave_field.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+#ifdef ARDUINO
+#include "Arduino.h"
+#else
+// Stand-in for the Arduino random(), for host builds
+static long random(long min, long max) {
+  return min + rand() % (max - min);
+}
+#endif
+
+/*
+ * Thin layer over the vector instructions used by stepWaveSpan(), so one kernel body serves every instruction set and field type.
+ * Arithmetic is always done in int32_t lanes; loadVector() and storeVector() widen and narrow int16_t field values with saturation.
+ * STENCIL_VECTOR_WIDTH is the number of lanes, or 1 where there is no vector implementation and only the scalar loop is used.
+ * The ESP32-S3 build currently falls back to the scalar loop. Its PIE vector unit has 128-bit registers with the saturating adds, shifts,
+ * and min/max a backend here would need, but the toolchain offers no intrinsics for it, only the EE.* instructions in inline assembly,
+ * whose loads need 16 byte alignment, so the unaligned neighbors of the stencil would have to be put together with EE.SRC.Q.
+ * A backend would have to be checked on the device with tools/stencil_check.cpp, which compares every mode against the scalar loop.
+ */
+#if SIMD_STENCIL && defined(__AVX2__)
+#include <immintrin.h>
+#define STENCIL_VECTOR_WIDTH 8
+typedef __m256i StencilVector;
+#if FIELD_INT16
+static inline StencilVector loadVector(const field_t *p) { return _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)p)); }
+static inline void storeVector(field_t *p, StencilVector x) {
+  _mm_storeu_si128((__m128i*)p, _mm256_castsi256_si128(_mm256_permute4x64_epi64(_mm256_packs_epi32(x, x), 0x08)));
+}
+#else
+static inline StencilVector loadVector(const field_t *p) { return _mm256_loadu_si256((const __m256i*)p); }
+static inline void storeVector(field_t *p, StencilVector x) { _mm256_storeu_si256((__m256i*)p, x); }
+#endif
+static inline StencilVector addVectors(StencilVector a, StencilVector b) { return _mm256_add_epi32(a, b); }
+static inline StencilVector subtractVectors(StencilVector a, StencilVector b) { return _mm256_sub_epi32(a, b); }
+static inline StencilVector orVectors(StencilVector a, StencilVector b) { return _mm256_or_si256(a, b); }
+static inline StencilVector shiftVector(StencilVector a, int bits) { return _mm256_sra_epi32(a, _mm_cvtsi32_si128(bits)); }
+static inline StencilVector capVector(StencilVector a) {
+  return _mm256_min_epi32(_mm256_max_epi32(a, _mm256_set1_epi32(MIN_RANGE)), _mm256_set1_epi32(MAX_RANGE));
+}
+static inline StencilVector zeroVector() { return _mm256_setzero_si256(); }
+static inline int32_t orLanes(StencilVector a) {
+  __m128i half = _mm_or_si128(_mm256_castsi256_si128(a), _mm256_extracti128_si256(a, 1));
+  half = _mm_or_si128(half, _mm_shuffle_epi32(half, 0x4E));
+  return _mm_cvtsi128_si32(_mm_or_si128(half, _mm_shuffle_epi32(half, 0xB1)));
+}
+#elif SIMD_STENCIL && defined(__SSE4_1__)
+#include <smmintrin.h>
+#define STENCIL_VECTOR_WIDTH 4
+typedef __m128i StencilVector;
+#if FIELD_INT16
+static inline StencilVector loadVector(const field_t *p) { return _mm_cvtepi16_epi32(_mm_loadl_epi64((const __m128i*)p)); }
+static inline void storeVector(field_t *p, StencilVector x) { _mm_storel_epi64((__m128i*)p, _mm_packs_epi32(x, x)); }
+#else
+static inline StencilVector loadVector(const field_t *p) { return _mm_loadu_si128((const __m128i*)p); }
+static inline void storeVector(field_t *p, StencilVector x) { _mm_storeu_si128((__m128i*)p, x); }
+#endif
+static inline StencilVector addVectors(StencilVector a, StencilVector b) { return _mm_add_epi32(a, b); }
+static inline StencilVector subtractVectors(StencilVector a, StencilVector b) { return _mm_sub_epi32(a, b); }
+static inline StencilVector orVectors(StencilVector a, StencilVector b) { return _mm_or_si128(a, b); }
+static inline StencilVector shiftVector(StencilVector a, int bits) { return _mm_sra_epi32(a, _mm_cvtsi32_si128(bits)); }
+static inline StencilVector capVector(StencilVector a) {
+  return _mm_min_epi32(_mm_max_epi32(a, _mm_set1_epi32(MIN_RANGE)), _mm_set1_epi32(MAX_RANGE));
+}
+static inline StencilVector zeroVector() { return _mm_setzero_si128(); }
+static inline int32_t orLanes(StencilVector a) {
+  a = _mm_or_si128(a, _mm_shuffle_epi32(a, 0x4E));
+  return _mm_cvtsi128_si32(_mm_or_si128(a, _mm_shuffle_epi32(a, 0xB1)));
+}
+#else
+#define STENCIL_VECTOR_WIDTH 1
+#endif
+
+#ifdef ESP_PLATFORM
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/event_groups.h"
+#include "esp_heap_caps.h"
+#include "soc/soc_memory_layout.h"
+#else
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#endif
+
+// Array of current wave amplitudes and their first partial derivatives with respect to time
+field_t *u, *v;
+// Array indicating pixel types (NORMAL_PIXEL, WALL_PIXEL, ABSORBANT_PIXEL, GLASS_PIXEL, etc.)
+uint8_t *pixelType;
+// Array for a full-screen image, 16-bit color encoding
+uint16_t *image;
+
+// Policy for placing the big buffers, and where each of them went (see allocateBuffer())
+uint8_t placementPolicy = PLANNED_PLACEMENT;
+BufferPlacement bufferPlacements[MAX_BUFFER_PLACEMENTS];
+int bufferPlacementCount = 0;
+BufferPlacement allocationFailure = { NULL, 0, HOST_RAM };
+
+// Size of the grid in screen pixels, set by setGridSize(), and the row stride of the per-cell arrays at full resolution
+int gridWidth = 0;
+int gridHeight = 0;
+int gridStride = 0;
+
+// Blocks laid out by setGridSize(): the field arena holds u and v, which every step reads and writes, and the type arena pixelType
+// and image, which it does not
+void *fieldArena = NULL;
+void *typeArena = NULL;
+// Buffer given by setImageBuffer() to use as the image array instead of one in the type arena, or NULL
+uint16_t *imageBuffer = NULL;
+
+// Each cell of the simulated field covers fieldScale x fieldScale pixels of the screen, so the field is fieldWidth x fieldHeight cells
+int fieldScale = 1;
+int fieldWidth = 0;
+int fieldHeight = 0;
+int fieldStride = 0;
+int tileColumns = 0;
+int tileRows = 0;
+
+// The step kernels color the field into fieldImage, one pixel per cell with rows fieldStride apart: this is the image array itself
+// at full resolution if the rows are not padded, and otherwise scaledImage, which is scaled up into the image array by scaleUpImage()
+uint16_t *fieldImage = NULL;
+uint16_t *scaledImage = NULL;
+
+// A horizontal band of whole tile rows, stepped by its own task
+struct SolverBand {
+  int firstTileRow;
+  int lastTileRow;
+  // Line buffers holding pre-step values of u for the previous and current rows, with a zero guard at each end
+  field_t *lineBuffer[2];
+  // Pre-step values of u for the first row of the band below, which may already be getting updated by another core
+  field_t *southHalo;
+  // Activity of each tile of the row of tiles being stepped, gathered by stepBand()
+  int32_t *tileActivity;
+  // Statistics of the pixels of the band stepped by the last rendered step (see FIELD_STATISTICS)
+  FieldStatistics statistics;
+};
+
+SolverBand bands[MAX_SOLVER_BANDS];
+int bandCount = 1;
+// Number of bands asked for by the last call to startSolverBands(), which may be more than a reduced resolution field has room for
+int requestedBandCount = 1;
+
+// Every SOURCE pixel in the field, set by applySources() after each step
+SourcePixel *sources = NULL;
+int sourceCount = 0;
+
+// Every OPEN_BOUNDARY pixel in the field, set by applyOpenBoundary() after each step
+BoundaryPixel *boundary = NULL;
+int boundaryCount = 0;
+
+// One turn of a sine wave with amplitude MAX_RANGE / 2, plus a repeat of the first entry so neighbors can be interpolated without wrapping
+int32_t sineTable[(1 << SINE_TABLE_BITS) + 1];
+
+// Per-pixel coefficients of GRADED pixels, in the formats given by WAVE_SPEED_SQUARED_BITS and DAMPING_RATE_BITS;
+// only allocated once a mode uses GRADED pixels
+uint16_t *waveSpeedSquared = NULL;
+uint16_t *dampingRate = NULL;
+
+#if INTENSITY_AVERAGE
+// Exponential moving average of the square of u for each cell (see INTENSITY_AVERAGE and sampleIntensityPixel()); only allocated
+// once the intensity view is first shown
+uint16_t *intensity = NULL;
+#endif
+
+// Colors of the shaded surface for each slope, in the color scale they were worked out for (see buildSurfaceShading())
+uint16_t surfaceShading[1 << (2 * SURFACE_TABLE_BITS)];
+uint8_t surfaceShadingScale = TOTAL_SCALE_COUNT;
+
+// Material spans for every row, in row and column order; the spans for row i are spans[rowFirstSpan[i]] up to spans[rowFirstSpan[i + 1]]
+MaterialSpan *spans = NULL;
+int *rowFirstSpan = NULL;
+
+// Per-tile flags: tiles to be stepped next, tiles left with nonzero u or v by the last step, and tiles containing SOURCE pixels;
+// each is a table of pointers to rows of flags, so they are indexed [tileRow][tileColumn] like a two dimensional array
+uint8_t **tileActive = NULL;
+uint8_t **tileNonZero = NULL;
+uint8_t **tileHasSource = NULL;
+// Tiles stepped since the image array was last updated
+uint8_t **tileStale = NULL;
+
+// Whether the step in progress updates the image array
+bool renderStep = true;
+
+uint8_t fieldView = AMPLITUDE_VIEW;
+// Whether the step in progress updates the average intensity
+bool sampleIntensity = false;
+uint8_t intensitySampleInterval = INTENSITY_SAMPLE_INTERVAL;
+
+// Bits of fieldFeatures, recording which materials other than NORMAL, WALL, SOURCE, and OPEN_BOUNDARY pixels the field contains
+#define ABSORBANT_FEATURE 1
+#define GLASS_FEATURE 2
+#define GRADED_FEATURE 4
+#define ALL_FEATURES (ABSORBANT_FEATURE | GLASS_FEATURE | GRADED_FEATURE)
+
+// Materials used by the current mode, set by compileSpans() to pick the version of stepBand() that steps the field
+uint8_t fieldFeatures = ALL_FEATURES;
+
+uint8_t normalDampingBitShift = LOW_DAMPING_BIT_SHIFT;
+uint8_t absorbantDampingBitShift = HIGH_DAMPING_BIT_SHIFT;
+
+uint32_t loopCounter = 0;
+
+uint8_t mode;
+uint8_t colorScale;
+uint8_t colorBitShift = COLOR_BIT_SHIFT;
+FieldStatistics fieldStatistics;
+uint8_t statisticsInterval = STATISTICS_INTERVAL;
+// Rendered steps since the field was initialized, and whether the step in progress gathers statistics
+uint32_t renderedStepCount = 0;
+bool measureStep = false;
+char label[48] = "";
+
+int32_t applyCap(int32_t x) {
+  if (x < MIN_RANGE) {
+    return MIN_RANGE;
+  }
+  if (x > MAX_RANGE) {
+    return MAX_RANGE;
+  }
+  return x;
+}
+
+/*
+ * Returns the distance between the starts of consecutive rows of a field width cells wide: the width rounded up so that every row
+ * of u and v starts on a FIELD_ALIGNMENT byte boundary.
+ */
+int rowStride(int width) {
+  const int cellsPerBlock = FIELD_ALIGNMENT / sizeof(field_t);
+  return (width + cellsPerBlock - 1) / cellsPerBlock * cellsPerBlock;
+}
+
+/*
+ * Rounds a number of bytes up to a multiple of FIELD_ALIGNMENT.
+ */
+static inline size_t alignSize(size_t bytes) {
+  return (bytes + FIELD_ALIGNMENT - 1) & ~(size_t)(FIELD_ALIGNMENT - 1);
+}
+
+/*
+ * Returns the first byte of a block on a FIELD_ALIGNMENT byte boundary, as allocateBuffer() only promises the alignment of malloc().
+ * The block must have been allocated FIELD_ALIGNMENT - 1 bytes larger than needed.
+ */
+static inline uint8_t *alignBlock(void *block) {
+  return (uint8_t*)(((uintptr_t)block + FIELD_ALIGNMENT - 1) & ~(uintptr_t)(FIELD_ALIGNMENT - 1));
+}
+
+/*
+ * Sets the size of the simulated field in cells, along with its row stride and the number of tiles covering it.
+ */
+void setFieldDimensions(int width, int height) {
+  fieldWidth = width;
+  fieldHeight = height;
+  fieldStride = rowStride(width);
+  tileColumns = (width + TILE_WIDTH - 1) / TILE_WIDTH;
+  tileRows = (height + TILE_HEIGHT - 1) / TILE_HEIGHT;
+}
+
+/*
+ * Allocates a zeroed buffer for one of the arrays that cover the grid, placed as placementPolicy says, and records where it went under
+ * the given name in bufferPlacements. Hot buffers are the ones every step reads or writes, which PLANNED_PLACEMENT puts in internal RAM
+ * as long as INTERNAL_RAM_RESERVE bytes of it are left over afterwards; the rest go in PSRAM, which is several times slower to reach
+ * once a buffer no longer fits in the cache. Anything that cannot be placed as planned goes wherever malloc() finds room, and NULL is
+ * returned only if there is no room anywhere, in which case the buffer is recorded in allocationFailure instead.
+ * Hot buffers should be allocated first, since they get internal RAM in that order.
+ */
+void *allocateBuffer(const char *name, size_t bytes, bool hot) {
+  void *buffer = NULL;
+  uint8_t region = HOST_RAM;
+#ifdef ESP_PLATFORM
+  const uint32_t internal = MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT;
+  if (placementPolicy == PLANNED_PLACEMENT && hot && heap_caps_get_largest_free_block(internal) >= bytes
+      && heap_caps_get_free_size(internal) >= bytes + INTERNAL_RAM_RESERVE) {
+    buffer = heap_caps_calloc(1, bytes, internal);
+  }
+  if (buffer == NULL && placementPolicy != DEFAULT_PLACEMENT) {
+    buffer = heap_caps_calloc(1, bytes, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+  }
+  if (buffer == NULL) {
+    buffer = calloc(1, bytes);
+  }
+  region = esp_ptr_external_ram(buffer) ? EXTERNAL_RAM : INTERNAL_RAM;
+#else
+  // Host builds have one kind of RAM
+  (void)hot;
+  buffer = calloc(1, bytes);
+#endif
+  if (buffer == NULL) {
+    allocationFailure = { name, bytes, region };
+    return NULL;
+  }
+  // A buffer allocated again under the same name replaces its old entry
+  int entry = 0;
+  while (entry < bufferPlacementCount && strcmp(bufferPlacements[entry].name, name) != 0) {
+    entry++;
+  }
+  if (entry < MAX_BUFFER_PLACEMENTS) {
+    bufferPlacements[entry] = { name, bytes, region };
+    bufferPlacementCount = std::max(bufferPlacementCount, entry + 1);
+  }
+  return buffer;
+}
+
+/*
+ * Allocates a table of pointers to rows of per-tile flags, with the rows in the same block, so the flags can be indexed [tileRow][tileColumn].
+ */
+uint8_t **allocateTileFlags(int rows, int columns) {
+  uint8_t **table = (uint8_t**)calloc(1, rows * sizeof(uint8_t*) + rows * columns);
+  if (table != NULL) {
+    uint8_t *flags = (uint8_t*)(table + rows);
+    for (int row = 0; row < rows; row++) {
+      table[row] = flags + row * columns;
+    }
+  }
+  return table;
+}
+
+/*
+ * Makes the grid width x height pixels, which should be the size of the screen, allocating u, v, pixelType, and image to match along with
+ * the per-row and per-tile state of the solver. Anything allocated for an earlier grid is freed first. The field scale and number of bands
+ * are kept. Returns false if there is not enough memory, with the buffer that could not be allocated in allocationFailure, leaving
+ * an empty grid that must not be stepped until setGridSize() succeeds. Call initializeField() afterwards.
+ * u and v share the field arena, a hot buffer, and pixelType and image the type arena, a cold one, so that u and v can have internal
+ * RAM to themselves. Each array starts on a FIELD_ALIGNMENT byte boundary, and the rows of u, v, and pixelType are rowStride() cells
+ * apart. u and v each have a guard row of zeros above the first row and below the last one, so the rows either side of any row of
+ * the field can be read without checking. The image is left out of the type arena if setImageBuffer() has given a buffer for it.
+ */
+bool setGridSize(int width, int height) {
+  free(fieldArena);
+  free(typeArena);
+  fieldArena = typeArena = NULL;
+  u = v = NULL;
+  pixelType = NULL;
+  image = NULL;
+  free(rowFirstSpan);
+  free(tileActive);
+  free(tileNonZero);
+  free(tileHasSource);
+  free(tileStale);
+  bufferPlacementCount = 0;
+  allocationFailure.name = NULL;
+  // GRADED coefficients are allocated again at the new size by the first mode that uses them
+  free(waveSpeedSquared);
+  free(dampingRate);
+  waveSpeedSquared = dampingRate = NULL;
+#if INTENSITY_AVERAGE
+  free(intensity);
+  intensity = NULL;
+#endif
+  for (int b = 0; b < MAX_SOLVER_BANDS; b++) {
+    free(bands[b].lineBuffer[0]);
+    free(bands[b].lineBuffer[1]);
+    free(bands[b].southHalo);
+    free(bands[b].tileActivity);
+    bands[b].lineBuffer[0] = bands[b].lineBuffer[1] = bands[b].southHalo = NULL;
+  }
+
+  int columns = (width + TILE_WIDTH - 1) / TILE_WIDTH;
+  int rows = (height + TILE_HEIGHT - 1) / TILE_HEIGHT;
+  int stride = rowStride(width);
+  size_t fieldBytes = alignSize((size_t)(height + 2) * stride * sizeof(field_t));
+  size_t typeBytes = alignSize((size_t)height * stride);
+  size_t imageBytes = imageBuffer != NULL ? 0 : alignSize((size_t)width * height * sizeof(uint16_t));
+  // Each big buffer is only allocated if the last one was, so that allocationFailure names the one that ran out
+  fieldArena = allocateBuffer("field arena", 2 * fieldBytes + FIELD_ALIGNMENT - 1, true);
+  if (fieldArena != NULL) {
+    uint8_t *block = alignBlock(fieldArena);
+    u = (field_t*)block + stride;
+    v = (field_t*)(block + fieldBytes) + stride;
+    typeArena = allocateBuffer("type arena", typeBytes + imageBytes + FIELD_ALIGNMENT - 1, false);
+  }
+  if (typeArena != NULL) {
+    uint8_t *block = alignBlock(typeArena);
+    pixelType = block;
+    image = imageBuffer != NULL ? imageBuffer : (uint16_t*)(block + typeBytes);
+  }
+  rowFirstSpan = (int*)calloc(height + 1, sizeof(int));
+  tileActive = allocateTileFlags(rows, columns);
+  tileNonZero = allocateTileFlags(rows, columns);
+  tileHasSource = allocateTileFlags(rows, columns);
+  tileStale = allocateTileFlags(rows, columns);
+  bool allocated = fieldArena && typeArena && rowFirstSpan && tileActive && tileNonZero && tileHasSource && tileStale;
+#if INTENSITY_AVERAGE
+  if (fieldView == INTENSITY_VIEW && typeArena != NULL) {
+    intensity = (uint16_t*)allocateBuffer("intensity", stride * height * sizeof(uint16_t), true);
+    allocated = allocated && intensity;
+  }
+#endif
+  for (int b = 0; b < MAX_SOLVER_BANDS; b++) {
+    bands[b].tileActivity = (int32_t*)malloc(columns * sizeof(int32_t));
+    allocated = allocated && bands[b].tileActivity;
+#if !LEAPFROG_STEP
+    bands[b].lineBuffer[0] = (field_t*)calloc(width + 2, sizeof(field_t));
+    bands[b].lineBuffer[1] = (field_t*)calloc(width + 2, sizeof(field_t));
+    bands[b].southHalo = (field_t*)malloc(width * sizeof(field_t));
+    allocated = allocated && bands[b].lineBuffer[0] && bands[b].lineBuffer[1] && bands[b].southHalo;
+#endif
+  }
+
+  if (!allocated) {
+    // Whatever was allocated is freed by the next call
+    if (allocationFailure.name == NULL) {
+      allocationFailure = { "solver state", 0, HOST_RAM };
+    }
+    gridWidth = gridHeight = gridStride = 0;
+    setFieldDimensions(0, 0);
+    return false;
+  }
+  gridWidth = width;
+  gridHeight = height;
+  gridStride = stride;
+  if (!setFieldScale(fieldScale)) {
+    gridWidth = gridHeight = gridStride = 0;
+    setFieldDimensions(0, 0);
+    return false;
+  }
+  return true;
+}
+
+/*
+ * Has the image drawn straight into buffer, width x height pixels for the next setGridSize(width, height), instead of an array of the
+ * solver's own; typically the frame buffer of a sprite, which can then go to the screen without a copy. NULL goes back to an array in the
+ * type arena. Takes effect on the next setGridSize(), and the buffer must outlive the grid. The step only redraws the parts of the image
+ * that change, so anything else drawn over the buffer stays there until the caller puts those pixels back.
+ */
+void setImageBuffer(uint16_t *buffer) {
+  imageBuffer = buffer;
+}
+
+/*
+ * Given row i, column j returns index into u, v, pixelType, and the other per-cell arrays, whose rows are fieldStride cells apart.
+ * Used extensively from within clearField(), initalizeField(), and when processing touch events;
+ * avoided elsewhere because it does multiplication.
+ */
+int toIndex(int i, int j) {
+  return (i * fieldStride) + j;
+}
+
+/*
+ * Marks every tile active, so the whole field is stepped and redrawn on the next step.
+ */
+void activateAllTiles() {
+  for (int tileRow = 0; tileRow < tileRows; tileRow++) {
+    for (int tileColumn = 0; tileColumn < tileColumns; tileColumn++) {
+      tileActive[tileRow][tileColumn] = 1;
+      tileNonZero[tileRow][tileColumn] = 1;
+    }
+  }
+}
+
+/*
+ * Called whenever v is set from outside the simulation step (i.e. by touch events) to make sure the tile containing row i, column j gets stepped.
+ */
+void wakeTile(int i, int j) {
+  tileActive[i / TILE_HEIGHT][j / TILE_WIDTH] = 1;
+  tileNonZero[i / TILE_HEIGHT][j / TILE_WIDTH] = 1;
+}
+
+/*
+ * Sets the rate of change of u at row i, column j (i.e. for a touch event), and wakes its tile.
+ * With LEAPFROG_STEP, v holds the previous value of u instead, so it is set to the value u would have had one step ago when changing at that rate.
+ * Only pixels the step updates are changed, since any other pixel's v would become its u at the next swap. Cells outside the field are ignored.
+ */
+void setVelocity(int i, int j, int32_t velocity) {
+  if (i < 0 || j < 0 || i >= fieldHeight || j >= fieldWidth) {
+    return;
+  }
+  int index = toIndex(i, j);
+#if LEAPFROG_STEP
+  uint8_t type = pixelType[index];
+  if (type == NORMAL_PIXEL || type == ABSORBANT_PIXEL) {
+    v[index] = applyCap(u[index] - velocity);
+  } else if (type == GLASS_PIXEL) {
+    v[index] = applyCap(u[index] - (velocity >> GLASS_REFRACTION_BIT_SHIFT));
+  } else if (type == GRADED_PIXEL) {
+    v[index] = applyCap(u[index] - (int32_t)(((int64_t)velocity * waveSpeedSquared[index]) >> WAVE_SPEED_SQUARED_BITS));
+  }
+#else
+  v[index] = velocity;
+#endif
+  wakeTile(i, j);
+}
+
+/*
+ * Selects what the image shows: u itself (AMPLITUDE_VIEW), the time averaged intensity of the waves (INTENSITY_VIEW), which shows standing
+ * patterns such as the fringes of DOUBLE_SLIT_DIFFRACTION_MODE much more clearly, or u as the height of a shaded surface (SURFACE_VIEW).
+ * The intensity is averaged from zero each time its view is selected, in a plane that is allocated the first time. Returns false
+ * if there is not enough memory for it, or if INTENSITY_AVERAGE is 0, leaving the view as it was.
+ */
+bool setFieldView(uint8_t view) {
+#if INTENSITY_AVERAGE
+  if (view == INTENSITY_VIEW && intensity == NULL) {
+    intensity = (uint16_t*)allocateBuffer("intensity", gridStride * gridHeight * sizeof(uint16_t), true);
+    if (intensity == NULL) {
+      return false;
+    }
+  } else if (view == INTENSITY_VIEW && fieldView != INTENSITY_VIEW) {
+    memset(intensity, 0, gridStride * gridHeight * sizeof(uint16_t));
+  }
+#else
+  if (view == INTENSITY_VIEW) {
+    return false;
+  }
+#endif
+  fieldView = view;
+  activateAllTiles(); // Every pixel needs drawing again
+  return true;
+}
+
+/*
+ * Sets the type of the pixel at row i, column j, for use from within initializeField(). The mode layouts are drawn for a 320 x 170 screen,
+ * so on other grids some pixels can fall outside, and are skipped. So are pixels of the stepped materials on the edge of the grid,
+ * which the step relies on never having to update.
+ */
+void drawPixel(int i, int j, uint8_t type) {
+  if (i < 0 || j < 0 || i >= gridHeight || j >= gridWidth) {
+    return;
+  }
+  bool edge = i == 0 || j == 0 || i == gridHeight - 1 || j == gridWidth - 1;
+  if (edge && (type == NORMAL_PIXEL || type == ABSORBANT_PIXEL || type == GLASS_PIXEL)) {
+    return;
+  }
+  pixelType[toIndex(i, j)] = type;
+}
+
+/*
+ * Makes the pixel at the given index a GRADED pixel with the given coefficients (see WAVE_SPEED_SQUARED_BITS and DAMPING_RATE_BITS).
+ * For use from within initializeField(); allocates the coefficient arrays the first time it is called.
+ */
+void setGradedPixel(int index, uint16_t speedSquared, uint16_t damping) {
+  if (waveSpeedSquared == NULL) {
+    waveSpeedSquared = (uint16_t*)allocateBuffer("waveSpeedSquared", gridStride * gridHeight * sizeof(uint16_t), true);
+    dampingRate = (uint16_t*)allocateBuffer("dampingRate", gridStride * gridHeight * sizeof(uint16_t), true);
+  }
+  if (waveSpeedSquared == NULL || dampingRate == NULL) {
+    return; // Not enough memory; the pixel keeps its type
+  }
+  pixelType[index] = GRADED_PIXEL;
+  waveSpeedSquared[index] = speedSquared;
+  dampingRate[index] = damping;
+}
+
+/*
+ * Turns the WALL pixels along the given edges of the field into OPEN_BOUNDARY pixels, so that waves pass out through them instead of being reflected.
+ * For use from within initializeField(), straight after clearField().
+ */
+void openBoundary(bool north, bool east, bool south, bool west) {
+  for (int i = 0; i < fieldHeight; i++) {
+    for (int j = 0; j < fieldWidth; j++) {
+      if ((north && i == 0) || (east && j == fieldWidth - 1) || (south && i == fieldHeight - 1) || (west && j == 0)) {
+        pixelType[toIndex(i, j)] = OPEN_BOUNDARY_PIXEL;
+      }
+    }
+  }
+}
+
+/*
+ * Builds the table of OPEN_BOUNDARY pixels applied by applyOpenBoundary(), pairing each one with its neighbor on the inside of the field
+ * (the diagonal neighbor for a corner). Runs at the end of initializeField().
+ */
+void compileBoundary() {
+  boundaryCount = 0;
+  for (int i = 0; i < fieldHeight; i++) {
+    for (int j = 0; j < fieldWidth; j++) {
+      if (pixelType[toIndex(i, j)] == OPEN_BOUNDARY_PIXEL) {
+        boundaryCount++;
+      }
+    }
+  }
+  boundary = (BoundaryPixel*)realloc(boundary, std::max(boundaryCount, 1) * sizeof(BoundaryPixel));
+
+  int boundaryIndex = 0;
+  for (int i = 0; i < fieldHeight; i++) {
+    for (int j = 0; j < fieldWidth; j++) {
+      if (pixelType[toIndex(i, j)] != OPEN_BOUNDARY_PIXEL) {
+        continue;
+      }
+      BoundaryPixel *pixel = &boundary[boundaryIndex++];
+      pixel->index = toIndex(i, j);
+      pixel->neighbor = toIndex(std::min(std::max(i, 1), fieldHeight - 2), std::min(std::max(j, 1), fieldWidth - 2));
+      pixel->neighborU = 0;
+    }
+  }
+}
+
+/*
+ * Builds the table of SOURCE pixels applied by applySources(), and records which tiles contain them; these are kept active permanently.
+ * Also fills in the sine table the first time round. Runs at the end of initializeField().
+ */
+void compileSources() {
+  if (sineTable[1 << (SINE_TABLE_BITS - 2)] == 0) {
+    for (int k = 0; k <= (1 << SINE_TABLE_BITS); k++) {
+      sineTable[k] = (MAX_RANGE >> 1) * sin(2 * M_PI * k / (1 << SINE_TABLE_BITS));
+    }
+  }
+
+  // Phase increments per step for the low, mid, and high frequencies, and the phase step between neighboring PHASED_ARRAY_SOURCE pixels
+  // Cells larger than a pixel carry waves across the screen fieldScale times faster, so the frequencies are raised to match to keep the same wavelengths on screen
+  const double turn = 4294967296.0;
+  uint32_t lowFrequencyIncrement = (uint32_t)(0.5 * fieldScale * RADIANS_PER_ITERATION / (2 * M_PI) * turn);
+  uint32_t midFrequencyIncrement = (uint32_t)(fieldScale * RADIANS_PER_ITERATION / (2 * M_PI) * turn);
+  uint32_t highFrequencyIncrement = (uint32_t)(2 * fieldScale * RADIANS_PER_ITERATION / (2 * M_PI) * turn);
+  double phasedArrayPhasePerPixel = -0.5 * fieldScale * RADIANS_PER_PIXEL / (2 * M_PI);
+
+  sourceCount = 0;
+  for (int i = 0; i < fieldHeight; i++) {
+    for (int j = 0; j < fieldWidth; j++) {
+      if (IS_SOURCE_PIXEL(pixelType[toIndex(i, j)])) {
+        sourceCount++;
+      }
+    }
+  }
+  sources = (SourcePixel*)realloc(sources, std::max(sourceCount, 1) * sizeof(SourcePixel));
+
+  for (int tileRow = 0; tileRow < tileRows; tileRow++) {
+    memset(tileHasSource[tileRow], 0, tileColumns);
+  }
+  int sourceIndex = 0;
+  for (int i = 0; i < fieldHeight; i++) {
+    for (int j = 0; j < fieldWidth; j++) {
+      int index = toIndex(i, j);
+      uint8_t pixelStatus = pixelType[index];
+      if (!IS_SOURCE_PIXEL(pixelStatus)) {
+        continue;
+      }
+      tileHasSource[i / TILE_HEIGHT][j / TILE_WIDTH] = 1;
+      SourcePixel *source = &sources[sourceIndex++];
+      source->index = index;
+      // NEG source types are half a turn out of phase with their POS counterparts
+      source->phaseOffset = (pixelStatus & 1) ? 0x80000000u : 0;
+      switch (pixelStatus) {
+        case LOW_FREQ_POS_SOURCE_PIXEL:
+        case LOW_FREQ_NEG_SOURCE_PIXEL:
+          source->phaseIncrement = lowFrequencyIncrement;
+          break;
+        case MID_FREQ_POS_SOURCE_PIXEL:
+        case MID_FREQ_NEG_SOURCE_PIXEL:
+          source->phaseIncrement = midFrequencyIncrement;
+          break;
+        case HIGH_FREQ_POS_SOURCE_PIXEL:
+        case HIGH_FREQ_NEG_SOURCE_PIXEL:
+          source->phaseIncrement = highFrequencyIncrement;
+          break;
+        default:
+          // PHASED_ARRAY_MODE has a horizontal line of phased array pixels; they introduce a sinusoidal dependence on index (spatial variable)
+          double phase = phasedArrayPhasePerPixel * (i * fieldWidth + j);
+          source->phaseOffset = (uint32_t)(int64_t)((phase - floor(phase)) * turn);
+          source->phaseIncrement = lowFrequencyIncrement;
+          break;
+      }
+    }
+  }
+}
+
+/*
+ * Decides which tiles need stepping next time. Since the stencil only reaches one pixel north, south, east, or west,
+ * a disturbance can only spill into a tile from the four tiles sharing an edge with it, or with ISOTROPIC_LAPLACIAN, the four sharing a corner as well.
+ */
+void updateActiveTiles() {
+  for (int tileRow = 0; tileRow < tileRows; tileRow++) {
+    for (int tileColumn = 0; tileColumn < tileColumns; tileColumn++) {
+      tileActive[tileRow][tileColumn] = !ACTIVE_TILE_TRACKING
+        || tileHasSource[tileRow][tileColumn]
+        || tileNonZero[tileRow][tileColumn]
+        || (tileRow > 0 && tileNonZero[tileRow - 1][tileColumn])
+        || (tileRow < tileRows - 1 && tileNonZero[tileRow + 1][tileColumn])
+        || (tileColumn > 0 && tileNonZero[tileRow][tileColumn - 1])
+        || (tileColumn < tileColumns - 1 && tileNonZero[tileRow][tileColumn + 1])
+        || (ISOTROPIC_LAPLACIAN && tileRow > 0 && tileColumn > 0 && tileNonZero[tileRow - 1][tileColumn - 1])
+        || (ISOTROPIC_LAPLACIAN && tileRow > 0 && tileColumn < tileColumns - 1 && tileNonZero[tileRow - 1][tileColumn + 1])
+        || (ISOTROPIC_LAPLACIAN && tileRow < tileRows - 1 && tileColumn > 0 && tileNonZero[tileRow + 1][tileColumn - 1])
+        || (ISOTROPIC_LAPLACIAN && tileRow < tileRows - 1 && tileColumn < tileColumns - 1 && tileNonZero[tileRow + 1][tileColumn + 1]);
+    }
+  }
+}
+
+/*
+ * Compiles each row of the pixelType array into a run-length list of material spans for stepFieldFused(). Runs at the end of initializeField().
+ * Since WALL pixels never change, this also draws them into the image array once and for all.
+ */
+void compileSpans() {
+  int spanCount = 0;
+  for (int i = 0; i < fieldHeight; i++) {
+    for (int j = 0; j < fieldWidth; j++) {
+      int index = toIndex(i, j);
+      if (j == 0 || pixelType[index] != pixelType[index - 1]) {
+        spanCount++;
+      }
+    }
+  }
+  spans = (MaterialSpan*)realloc(spans, spanCount * sizeof(MaterialSpan));
+
+  int spanIndex = 0;
+  fieldFeatures = 0;
+  for (int i = 0; i < fieldHeight; i++) {
+    rowFirstSpan[i] = spanIndex;
+    for (int j = 0; j < fieldWidth; j++) {
+      int index = toIndex(i, j);
+      if (j == 0 || pixelType[index] != pixelType[index - 1]) {
+        spans[spanIndex].start = j;
+        spans[spanIndex].type = pixelType[index];
+        spanIndex++;
+        switch (pixelType[index]) {
+          case ABSORBANT_PIXEL:
+            fieldFeatures |= ABSORBANT_FEATURE;
+            break;
+          case GLASS_PIXEL:
+            fieldFeatures |= GLASS_FEATURE;
+            break;
+          case GRADED_PIXEL:
+            fieldFeatures |= GRADED_FEATURE;
+            break;
+        }
+      }
+      spans[spanIndex - 1].end = j + 1;
+      if (pixelType[index] == WALL_PIXEL) {
+        fieldImage[index] = WALL_COLOR;
+      }
+    }
+  }
+  rowFirstSpan[fieldHeight] = spanIndex;
+}
+
+/*
+ * Builds the tables the step runs from, for the OPEN_BOUNDARY pixels, the SOURCE pixels, and the material spans, out of the pixelType array.
+ * Runs at the end of initializeField(); host tools that change pixelType by hand afterwards call it again themselves.
+ */
+void compileField() {
+  compileBoundary();
+  compileSources();
+  compileSpans();
+}
+
+/*
+ * Ranks pixel types for reduceField(), which keeps the highest ranked type found in each block of pixels:
+ * SOURCE pixels first so no source is lost, then WALL pixels so thin walls stay closed, then the rest from the most to the least unusual material.
+ */
+int reductionRank(uint8_t pixelStatus) {
+  if (IS_SOURCE_PIXEL(pixelStatus)) {
+    return 6;
+  }
+  switch (pixelStatus) {
+    case WALL_PIXEL:
+      return 5;
+    case OPEN_BOUNDARY_PIXEL:
+      return 4;
+    case GRADED_PIXEL:
+      return 3;
+    case GLASS_PIXEL:
+      return 2;
+    case ABSORBANT_PIXEL:
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+/*
+ * Shrinks the pixelType array drawn by initializeField() at screen resolution down to fieldWidth x fieldHeight cells of fieldScale x fieldScale pixels,
+ * in place, giving each cell the highest ranked type in its block (see reductionRank()). GRADED cells take the coefficients of the pixel they came from.
+ * Blocks in the last row and column of cells are cut short where the scale does not divide the size of the grid.
+ */
+void reduceField() {
+  for (int i = 0; i < fieldHeight; i++) {
+    int blockHeight = std::min(fieldScale, gridHeight - i * fieldScale);
+    for (int j = 0; j < fieldWidth; j++) {
+      int blockWidth = std::min(fieldScale, gridWidth - j * fieldScale);
+      int from = (i * gridStride + j) * fieldScale;
+      for (int k = 0; k < blockHeight; k++) {
+        for (int l = 0; l < blockWidth; l++) {
+          int pixel = (i * fieldScale + k) * gridStride + j * fieldScale + l;
+          if (reductionRank(pixelType[pixel]) > reductionRank(pixelType[from])) {
+            from = pixel;
+          }
+        }
+      }
+      // Cells never land after the pixels they are reduced from, so nothing is overwritten before it has been read
+      int index = toIndex(i, j);
+      pixelType[index] = pixelType[from];
+      if (pixelType[from] == GRADED_PIXEL) {
+        waveSpeedSquared[index] = waveSpeedSquared[from];
+        dampingRate[index] = dampingRate[from];
+      }
+    }
+  }
+}
+
+/*
+ * Selects the resolution of the simulation: each cell of the field covers scale x scale pixels of the screen, cutting the work per step
+ * by a factor of scale squared. Where the scale does not divide the size of the grid, the last row and column of cells are only partly
+ * on the screen. Returns false if there is not enough memory for the scaledImage the new scale needs, with it in allocationFailure,
+ * leaving the field at its current scale. Call initializeField() afterwards.
+ */
+bool setFieldScale(int scale) {
+  int width = (gridWidth + scale - 1) / scale;
+  int height = (gridHeight + scale - 1) / scale;
+  // The new image is allocated before the old one is freed, so that the current scale still works if it cannot be
+  uint16_t *buffer = NULL;
+  if (scale > 1 || rowStride(width) != width) {
+    buffer = (uint16_t*)allocateBuffer("scaledImage", rowStride(width) * height * sizeof(uint16_t), true);
+    if (buffer == NULL) {
+      return false;
+    }
+  }
+  free(scaledImage);
+  scaledImage = buffer;
+  fieldScale = scale;
+  setFieldDimensions(width, height);
+  startSolverBands(requestedBandCount); // Band boundaries depend on the number of tile rows
+  return true;
+}
+
+/*
+ * Used extensively from within initializeField().
+ * Sets values in pixelStatus array to WALL_PIXEL along edges, ABSORBANT_PIXEL within specified padding regions, and NORMAL_PIXEL everywhere else.
+ */
+void clearField(int northPadding, int eastPadding, int southPadding, int westPadding) {
+  // The padding at the end of each row is cleared too, since a reduced field lays its rows over it
+  memset(u, 0, gridStride * gridHeight * sizeof(field_t));
+  memset(v, 0, gridStride * gridHeight * sizeof(field_t));
+  memset(image, 0, gridWidth * gridHeight * sizeof(uint16_t));
+  for (int i = 0; i < gridHeight; i++) {
+    for (int j = 0; j < gridWidth; j++) {
+      int index = toIndex(i, j);
+      pixelType[index] = NORMAL_PIXEL;
+      if (i < northPadding + 1 || j < westPadding + 1 || i >= gridHeight - southPadding - 1 || j >= gridWidth - eastPadding - 1) {
+        pixelType[index] = ABSORBANT_PIXEL;
+      }
+      if (i == 0 || j == 0 || i == gridHeight - 1 || j == gridWidth - 1) {
+        pixelType[index] = WALL_PIXEL;
+      }
+    }
+  }
+  activateAllTiles(); // Every pixel needs drawing at least once
+  loopCounter = 0; // Reset phase of sine wave used for SOURCE type pixels
+  colorBitShift = COLOR_BIT_SHIFT;
+  memset(&fieldStatistics, 0, sizeof(fieldStatistics));
+  renderedStepCount = 0;
+#if INTENSITY_AVERAGE
+  if (intensity != NULL) {
+    memset(intensity, 0, gridStride * gridHeight * sizeof(uint16_t));
+  }
+#endif
+}
+
+/*
+ * Sets up the absorbing boundary of the *_ABSORBER_MODE variants: OPEN_BOUNDARY pixels along every edge, or with OPEN_BOUNDARY set to 0,
+ * 15 pixel bands of ABSORBANT pixels.
+ */
+void clearAbsorberField() {
+#if OPEN_BOUNDARY
+  clearField(0, 0, 0, 0);
+  openBoundary(true, true, true, true);
+#else
+  clearField(15, 15, 15, 15);
+#endif
+}
+
+/*
+ * Huge function that initializes values in pixelStatus array for any given mode; runs only on startup and when the mode is updated.
+ */
+void initializeField() {
+
+  // The modes are drawn at screen resolution, and reduced to the size of the field at the end
+  setFieldDimensions(gridWidth, gridHeight);
+  int centerI = gridHeight >> 1;
+  int centerJ = gridWidth >> 1;
+  const char *suffix = "";
+  clearField(0, 0, 0, 0);
+  label[0] = '\0';
+
+  switch(mode) {
+    case TOUCH_ONLY_MODE:
+      strcpy(label, "TOUCH ONLY");
+      break;
+    case RANDOM_POINTS_ABSORBER_MODE:
+      suffix = " (ABSORBING BOUNDARY)";
+      clearAbsorberField(); // fall through
+    case RANDOM_POINTS_MODE:
+      for (int point = 0; point < 6; point++) {
+        drawPixel(random(30, gridHeight - 30), random(30, gridWidth - 30), point % 2 ? MID_FREQ_POS_SOURCE_PIXEL : MID_FREQ_NEG_SOURCE_PIXEL);
+      }
+      snprintf(label, sizeof(label), "RANDOM POINTS%s", suffix);
+      break;
+    case RANDOM_POINTS_MULTIFREQUENCY_ABSORBER_MODE:
+      suffix = " (ABSORBING BOUNDARY)";
+      clearAbsorberField(); // fall through
+    case RANDOM_POINTS_MULTIFREQUENCY_MODE:
+      drawPixel(random(30, gridHeight - 30), random(30, gridWidth - 30), MID_FREQ_POS_SOURCE_PIXEL);
+      drawPixel(random(30, gridHeight - 30), random(30, gridWidth - 30), MID_FREQ_NEG_SOURCE_PIXEL);
+      drawPixel(random(30, gridHeight - 30), random(30, gridWidth - 30), HIGH_FREQ_POS_SOURCE_PIXEL);
+      drawPixel(random(30, gridHeight - 30), random(30, gridWidth - 30), HIGH_FREQ_NEG_SOURCE_PIXEL);
+      drawPixel(random(30, gridHeight - 30), random(30, gridWidth - 30), LOW_FREQ_POS_SOURCE_PIXEL);
+      drawPixel(random(30, gridHeight - 30), random(30, gridWidth - 30), LOW_FREQ_NEG_SOURCE_PIXEL);
+      snprintf(label, sizeof(label), "MULTIFREQUENCY POINTS%s", suffix);
+      break;
+    case MONOPOLE_ABSORBER_MODE:
+      suffix = " (ABSORBING BOUNDARY)";
+      clearAbsorberField(); // fall through
+    case MONOPOLE_MODE:
+      drawPixel(centerI, centerJ, MID_FREQ_POS_SOURCE_PIXEL);
+      snprintf(label, sizeof(label), "MONOPOLE%s", suffix);
+      break;
+    case DIPOLE_ABSORBER_MODE:
+      suffix = " (ABSORBING BOUNDARY)";
+      clearAbsorberField(); // fall through
+    case DIPOLE_MODE:
+      drawPixel(centerI, centerJ - 10, MID_FREQ_NEG_SOURCE_PIXEL);
+      drawPixel(centerI, centerJ + 10, MID_FREQ_POS_SOURCE_PIXEL);
+      snprintf(label, sizeof(label), "DIPOLE%s", suffix);
+      break;
+    case QUADRUPOLE_ABSORBER_MODE:
+      suffix = " (ABSORBING BOUNDARY)";
+      clearAbsorberField(); // fall through
+    case QUADRUPOLE_MODE:
+      drawPixel(centerI - 10, centerJ - 10, MID_FREQ_POS_SOURCE_PIXEL);
+      drawPixel(centerI + 10, centerJ - 10, MID_FREQ_NEG_SOURCE_PIXEL);
+      drawPixel(centerI + 10, centerJ + 10, MID_FREQ_POS_SOURCE_PIXEL);
+      drawPixel(centerI - 10, centerJ + 10, MID_FREQ_NEG_SOURCE_PIXEL);      
+      snprintf(label, sizeof(label), "QUADRUPOLE%s", suffix);
+      break;
+    case SUPERPOSITION_MODE: {
+      int padding = 30;
+      clearField(padding, padding, padding, padding);
+      int halfWidth = 10;
+      int left = 100;
+      int top = 60;
+      int guideLength = 30;
+
+      for (int j = 1; j < guideLength; j++) {
+        drawPixel(top, j, WALL_PIXEL);
+        drawPixel(top + 4 * halfWidth, j, WALL_PIXEL);
+        for (int i = top + 1; i < top + 4 * halfWidth; i++) {
+          drawPixel(i, 1, LOW_FREQ_POS_SOURCE_PIXEL);
+          for (int j = 2; j <= padding; j++) {
+            drawPixel(i, j, NORMAL_PIXEL);
+          }
+        }
+      }
+      for (int i = 1; i < guideLength; i++) {
+        drawPixel(i, left, WALL_PIXEL);
+        drawPixel(i, left + halfWidth, WALL_PIXEL);
+        for (int j = left + 1; j < left + halfWidth; j++) {
+          drawPixel(1, j, HIGH_FREQ_POS_SOURCE_PIXEL);
+          for (int i = 2; i <= padding; i++) {
+            drawPixel(i, j, NORMAL_PIXEL);
+          }
+        }
+      }
+      strcpy(label, "SUPERPOSITION");
+      break;
+    }
+    case FLAT_MIRROR_MODE:
+      clearField(25, 25, 25, 0);
+      for (int i = 25; i < gridHeight - 25; i++) {
+        drawPixel(i, 1, MID_FREQ_POS_SOURCE_PIXEL);
+      }
+      for (int i = 50; i < gridHeight - 50; i++) {
+        drawPixel(i, 1.5 * i, WALL_PIXEL);
+      }
+      strcpy(label, "FLAT MIRROR");
+      break;
+    case PARABOLIC_MIRROR_MODE:
+      /* sideways version:
+      clearField(30, 10, 0, 10);
+      for (int i = 1; i < gridHeight - 1; i++) {
+        int j = (i - centerI) * (i - centerI) >> 5;
+        j += j >> 1;
+        for (int k = 0; k < 8; k++) {
+          drawPixel(i, j + k, WALL_PIXEL);
+        }
+      }
+      drawPixel(centerI, 15, HIGH_FREQ_POS_SOURCE_PIXEL);
+      */
+      clearField(40, 0, 0, 0);
+      // Starts where the curve leaves the bottom row: nearer the middle it would be on row gridHeight, past the end of the grid
+      for (int j = 13; j <= centerJ; j++) {
+        int y = (j * j) / 150;
+        drawPixel(gridHeight - y, centerJ - j, WALL_PIXEL);
+        drawPixel(gridHeight - y, centerJ + j, WALL_PIXEL);
+      }
+      for (int j = 10; j < gridWidth - 10; j++) {
+        drawPixel(0, j, HIGH_FREQ_POS_SOURCE_PIXEL);
+      }
+      strcpy(label, "PARABOLIC MIRROR");
+      break;
+    case ELLIPTIC_MIRROR_MODE: {
+      int a = centerJ;
+      int b = centerI;
+      for (int i = 0; i < gridHeight; i++) {
+        for (int j = 0; j < gridWidth; j++) {
+          int x = j - a;
+          int y = i - b;
+          int64_t rangeFactor = ((int64_t)x * x * b * b) + ((int64_t)a * a * y * y) - ((int64_t)a * a * b * b);
+          if (rangeFactor >= 0 && rangeFactor < 10000000) {
+            drawPixel(i, j, WALL_PIXEL);
+          }
+        }
+      }
+      drawPixel(b, 25, HIGH_FREQ_POS_SOURCE_PIXEL);
+      strcpy(label, "ELLIPTIC MIRROR");
+      break;
+    }
+    case REFRACTION_MODE:
+      clearField(20, 20, 20, 20);
+      for (int i = 25; i < gridHeight - 25; i++) {
+        for (int j = centerJ - 30; j <= centerJ + 30; j++) {
+          drawPixel(i, j, GLASS_PIXEL);
+        }
+        if (i > 100) {
+          drawPixel(i, i - 17, MID_FREQ_POS_SOURCE_PIXEL);
+        }
+      }
+      strcpy(label, "REFRACTION");
+      break;
+    case PRISM_MODE: {
+      clearField(20, 20, 20, 20);
+      for (int i = 20; i < 150; i++) {
+        int prismHalfWidth = (i - 20) * 75 / 130;
+        for (int j = centerJ - prismHalfWidth; j <= centerJ + prismHalfWidth; j++) {
+          drawPixel(i, j, GLASS_PIXEL);
+        }
+      }
+
+      for (int i = centerI; i < gridHeight - 20; i++) {
+        if (i > 130) {
+          drawPixel(i, (i - 70), MID_FREQ_POS_SOURCE_PIXEL);
+        }
+      }
+      strcpy(label, "PRISM");
+      break;
+    }
+    case LENS_MODE: {
+      clearField(20, 30, 20, 30);
+      int maxRadiusSquared = (centerJ + 100) * (centerJ + 100);
+      int leftRadialFocusHorizontalPosition = -140;
+      int rightRadialFocusHorizontalPosition = gridWidth + 40;
+      for (int i = 21; i < gridHeight - 21; i++) {
+        drawPixel(i, 0, HIGH_FREQ_POS_SOURCE_PIXEL);
+        for (int j = 22; j < gridWidth - 21; j++) {
+          if (((centerI - i) * (centerI - i)) + ((leftRadialFocusHorizontalPosition - j) * (leftRadialFocusHorizontalPosition - j)) < maxRadiusSquared) {
+            if (((centerI - i) * (centerI - i)) + ((rightRadialFocusHorizontalPosition - j) * (rightRadialFocusHorizontalPosition - j))  < maxRadiusSquared) {
+              drawPixel(i, j, GLASS_PIXEL);
+            }
+          }
+        }
+      }
+      strcpy(label, "LENS");
+      break;
+    }
+    case PARTIAL_INTERNAL_REFLECTION_MODE:
+      clearField(20, 20, 20, 10);
+      for (int i = centerI; i < gridHeight - 20; i++) {
+        for (int j = 1; j < gridWidth - 18; j++) {
+          drawPixel(i, j, GLASS_PIXEL);
+        }
+        if (i > 100) {
+          drawPixel(i, (i - 100) << 1, MID_FREQ_POS_SOURCE_PIXEL);
+          for (int j = 1; j < (i - 100) << 1; j++) {
+            drawPixel(i, j, ABSORBANT_PIXEL);
+          }
+        }
+      }
+      strcpy(label, "PARTIAL INTERNAL REFLECTION");
+      break;
+    case TOTAL_INTERNAL_REFLECTION_MODE:
+      clearField(20, 20, 20, 20);
+      for (int i = centerI; i < gridHeight - 20; i++) {
+        for (int j = 1; j < gridWidth - 18; j++) {
+          drawPixel(i, j, GLASS_PIXEL);
+        }
+        if (i > 100) {
+          drawPixel(i, (i - 100) >> 1, MID_FREQ_POS_SOURCE_PIXEL);
+          for (int j = 1; j < ((i - 100) >> 1); j++) {
+            drawPixel(i, j, ABSORBANT_PIXEL);
+          }
+        }
+      }
+      strcpy(label, "TOTAL INTERNAL REFLECTION");
+      break;
+    case FIBER_OPTIC_MODE: {
+      clearField(0, 40, 0, 10);
+
+      int topCenter = 40;
+      for (int i = topCenter - 15; i <= topCenter + 15; i++) {
+        for (int j = 2; j < gridWidth - 41; j++) {
+          drawPixel(i, j, GLASS_PIXEL);
+        }
+      }
+      for (int i = topCenter - 13; i <= topCenter + 13; i++) {
+        drawPixel(i, 1, LOW_FREQ_POS_SOURCE_PIXEL);
+      }
+
+      int middleCenter = centerI + 25;
+      for (int i = middleCenter - 8; i <= middleCenter + 8; i++) {
+        for (int j = 2; j < gridWidth - 41; j++) {
+          drawPixel(i, j, GLASS_PIXEL);
+        }
+      }
+      for (int i = middleCenter - 6; i <= middleCenter + 6; i++) {
+        drawPixel(i, 1, MID_FREQ_POS_SOURCE_PIXEL);
+      }
+
+      int bottomCenter = gridHeight - 20;
+      for (int i = bottomCenter - 4; i <= bottomCenter + 4; i++) {
+        for (int j = 2; j < gridWidth - 41; j++) {
+          drawPixel(i, j, GLASS_PIXEL);
+        }
+      }
+      for (int i = bottomCenter - 3; i <= bottomCenter + 3; i++) {
+        drawPixel(i, 1, HIGH_FREQ_POS_SOURCE_PIXEL);
+      }      
+      strcpy(label, "FIBER OPTIC CABLES");
+      break;
+    }
+    case WAVEGUIDE_MODE: {
+      clearField(15, 15, 15, 15);
+      int halfWidth = 25;
+      for (int j = 1; j < centerJ; j++) {
+        drawPixel(centerI - halfWidth, j, WALL_PIXEL);
+        drawPixel(centerI + halfWidth, j, WALL_PIXEL);
+      }
+      for (int i = centerI - halfWidth + 1; i < centerI + halfWidth - 1; i++) {
+        drawPixel(i, 1, i > centerI ? MID_FREQ_POS_SOURCE_PIXEL : MID_FREQ_NEG_SOURCE_PIXEL);
+        for (int j = 2; j <= 15; j++) {
+          drawPixel(i, j, NORMAL_PIXEL);
+        }
+      }
+      strcpy(label, "WAVEGUIDE");
+      break;
+    }
+    case PHASED_ARRAY_MODE:
+      clearField(15, 15, 15, 15);
+      for (int j = centerJ - 100; j < centerJ + 100; j++) {
+        drawPixel(centerI, j, PHASED_ARRAY_SOURCE_PIXEL);
+      }
+      strcpy(label, "PHASED ARRAY");
+      break;
+    case DOUBLE_SLIT_DIFFRACTION_MODE: {
+      clearField(20, 20, 0, 20);
+      int halfSlitWidth = 10;
+      for (int j = 0; j < gridWidth; j++) {
+        drawPixel(gridHeight - 1, j, ((j > centerJ - halfSlitWidth && j < centerJ + halfSlitWidth)
+          || (j < centerJ - (3 * halfSlitWidth))
+          || (j > centerJ + (3 * halfSlitWidth)))
+          ? WALL_PIXEL : MID_FREQ_POS_SOURCE_PIXEL);
+      }
+      strcpy(label, "DOUBLE SLIT DIFFRACTION");
+      break;
+    }
+    case DIFFRACTION_GRATING_MODE:
+      clearField(25, 20, 0, 20);
+      for (int j = 1; j < gridWidth - 1; j++) {
+        if (j > 110 && j < gridWidth - 110 && (j % 20 < 5 || j % 20 > 15)) {
+          drawPixel(gridHeight - 1, j, HIGH_FREQ_POS_SOURCE_PIXEL);
+        }
+      }
+      strcpy(label, "DIFFRACTION GRATING");
+      break;
+    case MAZE_MODE: {
+      bool leftward = true;
+      for (int i = gridHeight / 5; i < gridHeight; i += gridHeight / 5) {
+        if (leftward) {
+          for (int j = 0; j < gridWidth - (gridHeight / 5); j++) {
+            drawPixel(i, j, WALL_PIXEL);
+          }
+        } else {
+          for (int j = gridHeight / 5; j < gridWidth; j++) {
+            drawPixel(i, j, WALL_PIXEL);
+          }
+        }
+        leftward = !leftward;
+      }
+      for (int j = 1; j < (gridHeight / 5) - 1; j++) {
+        drawPixel(j, 1, MID_FREQ_POS_SOURCE_PIXEL);
+      }
+      strcpy(label, "MAZE");
+      break;
+    }
+    case GRADED_INDEX_LENS_MODE: {
+      // A slab whose refractive index falls from 2.0 on its axis to 1.0 at its top and bottom edges, bending plane waves towards the axis
+      clearField(20, 30, 20, 30);
+      int halfHeight = centerI - 21;
+      for (int i = 21; i < gridHeight - 21; i++) {
+        drawPixel(i, 0, HIGH_FREQ_POS_SOURCE_PIXEL);
+        double offset = (double)(i - centerI) / halfHeight;
+        double refractiveIndex = 2.0 - offset * offset;
+        uint16_t speedSquared = round(NORMAL_WAVE_SPEED_SQUARED / (refractiveIndex * refractiveIndex));
+        for (int j = centerJ - 30; j < centerJ + 30; j++) {
+          setGradedPixel(toIndex(i, j), speedSquared, NORMAL_DAMPING_RATE);
+        }
+      }
+      strcpy(label, "GRADED INDEX LENS");
+      break;
+    }
+    default:
+      label[0] = '\0';
+      break;
+  }
+
+  if (fieldScale > 1) {
+    setFieldDimensions((gridWidth + fieldScale - 1) / fieldScale, (gridHeight + fieldScale - 1) / fieldScale);
+    reduceField();
+    activateAllTiles();
+  }
+  fieldImage = fieldStride == fieldWidth && fieldScale == 1 ? image : scaledImage;
+  compileField();
+}
+
+/*
+ * Adds the extra color bits that mark ABSORBANT and GLASS pixels to a color.
+ */
+static constexpr uint16_t tintColor(uint8_t pixelStatus, uint16_t color) {
+  // ABSORBANT_PIXEL and GLASS_PIXEL need some extra color bits set for visibility
+  if (pixelStatus == ABSORBANT_PIXEL) {
+    // For ABSORBANT_PIXEL increase red, green, blue saturation
+    color |= 1024 | 32 | 1;
+  }
+  if (pixelStatus == GLASS_PIXEL) {
+    // For GLASS_PIXEL increase blue saturation only
+    color |= 2048;
+  }
+  return color;
+}
+
+// Channels making up each of the two hues of the fixed color scales, for positive and negative values of u
+#define RED_HUE 4
+#define GREEN_HUE 2
+#define BLUE_HUE 1
+
+constexpr uint8_t fixedScaleHues[FIXED_SCALE_COUNT][2] = {
+  { RED_HUE, BLUE_HUE },                         // RED_BLUE_SCALE
+  { RED_HUE | GREEN_HUE, RED_HUE | BLUE_HUE },   // YELLOW_PURPLE_SCALE
+  { RED_HUE, GREEN_HUE },                        // RED_GREEN_SCALE
+  { RED_HUE | GREEN_HUE, GREEN_HUE | BLUE_HUE }, // YELLOW_CYAN_SCALE
+  { GREEN_HUE, BLUE_HUE },                       // BLUE_GREEN_SCALE
+  { GREEN_HUE | BLUE_HUE, RED_HUE | BLUE_HUE },  // CYAN_PURPLE_SCALE
+};
+
+/*
+ * A hue of a color gradient, from black at the bottom of its levels through middle half way up to top, each as 0xRRGGBB.
+ */
+struct ColorHue {
+  uint32_t middle;
+  uint32_t top;
+};
+
+/*
+ * A color scale given as a gradient, with one hue for positive values of u and one for negative values.
+ */
+struct ColorGradient {
+  ColorHue positive;
+  ColorHue negative;
+};
+
+// Gradients of the color scales that follow the fixed ones, in order; to add a scale, add its gradient here and its *_SCALE to wave_field.h.
+// They are worked out into the color tables at compile time, at the full precision of the display for every one of the COLOR_LEVELS levels
+constexpr ColorGradient colorGradients[TOTAL_SCALE_COUNT - FIXED_SCALE_COUNT] = {
+  { { 0xC00000, 0xFFF040 }, { 0x0000C0, 0x40F0FF } }, // FIRE_ICE_SCALE
+};
+
+/*
+ * Encodes a color given as 8 bits each of red, green, and blue as RGB565 with its bytes swapped, the order the sprite keeps its pixels in.
+ */
+constexpr uint16_t spriteColor(uint32_t red, uint32_t green, uint32_t blue) {
+  uint16_t color = ((red >> 3) << 11) | ((green >> 2) << 5) | (blue >> 3);
+  return (uint16_t)((color >> 8) | (color << 8));
+}
+
+/*
+ * Works out one channel (shift picking it out of 0xRRGGBB) of a hue of a color gradient at the given level from 0 to COLOR_LEVELS - 1.
+ */
+constexpr uint32_t gradientChannel(const ColorHue &hue, int shift, int level) {
+  int32_t middle = (hue.middle >> shift) & 0xFF;
+  int32_t top = (hue.top >> shift) & 0xFF;
+  // Position along the gradient from 0 (black) through 255 (middle) to 510 (top)
+  int32_t position = level * 510 / (COLOR_LEVELS - 1);
+  return position <= 255 ? middle * position / 255 : middle + (top - middle) * (position - 255) / 255;
+}
+
+/*
+ * Works out the color of a hue of the given color scale at the given level, before any tint. The fixed scales keep the colors they have
+ * always had at 64 levels: a few of the top bits of each channel of their hue, which simply repeat when there are more levels.
+ */
+constexpr uint16_t scaleColor(int scale, bool isPositive, int level) {
+  if (scale >= FIXED_SCALE_COUNT) {
+    const ColorHue &hue = isPositive ? colorGradients[scale - FIXED_SCALE_COUNT].positive : colorGradients[scale - FIXED_SCALE_COUNT].negative;
+    return spriteColor(gradientChannel(hue, 16, level), gradientChannel(hue, 8, level), gradientChannel(hue, 0, level));
+  }
+  uint8_t hue = fixedScaleHues[scale][isPositive ? 0 : 1];
+  int val = level >> (COLOR_LEVEL_BITS - 6);
+  // Standard 16-bit RGB565-encoded color values (e.g. TFT_GREEN, etc.) produce bizarre colors when planted directly into image array
+  // because the sprite keeps them with their bytes swapped, which this encoding allows for
+  int red = ((val & 0xf8) << 2);
+  int green = val >> 3;
+  int blue = ((val & 0xfc) << 7);
+  return (hue & RED_HUE ? red : 0) | (hue & GREEN_HUE ? green : 0) | (hue & BLUE_HUE ? blue : 0);
+}
+
+/*
+ * Colors of every color scale, for each class of material, each sign of u, and each of the COLOR_LEVELS levels of its magnitude.
+ */
+struct ColorTables {
+  uint16_t colors[TOTAL_SCALE_COUNT][TOTAL_COLOR_CLASS_COUNT][2][COLOR_LEVELS];
+};
+
+// Pixel type drawn with the colors of each class of material, for its tint
+constexpr uint8_t colorClassPixels[TOTAL_COLOR_CLASS_COUNT] = { NORMAL_PIXEL, ABSORBANT_PIXEL, GLASS_PIXEL, WALL_PIXEL };
+
+constexpr ColorTables buildColorTables() {
+  ColorTables tables = {};
+  for (int scale = 0; scale < TOTAL_SCALE_COUNT; scale++) {
+    for (int colorClass = 0; colorClass < TOTAL_COLOR_CLASS_COUNT; colorClass++) {
+      for (int sign = 0; sign < 2; sign++) {
+        for (int level = 0; level < COLOR_LEVELS; level++) {
+          uint8_t pixelStatus = colorClassPixels[colorClass];
+          tables.colors[scale][colorClass][sign][level] = pixelStatus == WALL_PIXEL ? WALL_COLOR : tintColor(pixelStatus, scaleColor(scale, sign == 0, level));
+        }
+      }
+    }
+  }
+  return tables;
+}
+
+// Worked out by the compiler, so they cost nothing at run time and stay in flash on the ESP32-S3
+constexpr ColorTables colorTables = buildColorTables();
+
+// Class of material each pixel type is colored as (see colorClassPixels); SOURCE and OPEN_BOUNDARY pixels are drawn like NORMAL ones
+constexpr uint8_t pixelColorClass[] = {
+  PLAIN_COLORS, ABSORBANT_COLORS, GLASS_COLORS, WALL_COLORS, PLAIN_COLORS, PLAIN_COLORS, PLAIN_COLORS,
+  PLAIN_COLORS, PLAIN_COLORS, PLAIN_COLORS, PLAIN_COLORS, PLAIN_COLORS, PLAIN_COLORS,
+};
+static_assert(sizeof(pixelColorClass) == OPEN_BOUNDARY_PIXEL + 1, "every pixel type needs a class of material to be colored as");
+static_assert(COLOR_BIT_SHIFT - AUTO_GAIN_MAX_BOOST_BITS >= COLOR_LEVEL_BITS - 6, "not enough bits of u below the color scale for COLOR_LEVEL_BITS");
+
+/*
+ * Selects a 16-bit color from the current color scale for a pixel of the given type, the sign picking one of the two hues of the scale,
+ * and a level from 0 to COLOR_LEVELS - 1.
+ */
+static inline uint16_t shadeColor(uint8_t pixelStatus, bool isPositive, int level) {
+  return colorTables.colors[colorScale][pixelColorClass[pixelStatus]][isPositive ? 0 : 1][level];
+}
+
+/*
+ * Selects a 16-bit color for a pixel based on its type and its value in u.
+ */
+uint16_t colorize(uint8_t pixelStatus, int32_t value) {
+  // colorBitShift brings u down to 64 levels, so finer color scales shift it that much less
+  bool isPositive = value >= 0;
+  int32_t level = (isPositive ? value : -value) >> (colorBitShift + 6 - COLOR_LEVEL_BITS);
+  return shadeColor(pixelStatus, isPositive, std::min(level, (int32_t)COLOR_LEVELS - 1));
+}
+
+#if INTENSITY_AVERAGE
+/*
+ * Selects a 16-bit color for a pixel that isn't a WALL_PIXEL from its average intensity, in the first hue of the color scale.
+ * A steady wave whose peaks reach the top of the color scale in u averages half of 255 squared, which is drawn at the top of the scale too.
+ */
+uint16_t colorizeIntensity(uint8_t pixelStatus, uint16_t average) {
+  return shadeColor(pixelStatus, true, std::min(average >> (9 + 6 - COLOR_LEVEL_BITS), COLOR_LEVELS - 1));
+}
+#endif
+
+/*
+ * Works out the color of the shaded surface for every slope in the first hue of the current color scale, for shadeSurface() to look up.
+ * Entry (y << SURFACE_TABLE_BITS) + x is for slopes (x - 2^(SURFACE_TABLE_BITS - 1) + 1/2) / 8 eastwards and likewise for y southwards.
+ * The surface is lit by a light up and to the north west, with a diffuse term and a specular highlight (the Blinn-Phong model),
+ * so the fronts of waves facing the top left of the screen are bright and their backs are dark. A flat surface is about half way up the scale.
+ */
+void buildSurfaceShading() {
+  // Unit vectors towards the light, and half way between it and the viewer looking straight down
+  const double light[3] = { -0.5, -0.5, M_SQRT1_2 };
+  double halfLength = sqrt(light[0] * light[0] + light[1] * light[1] + (light[2] + 1) * (light[2] + 1));
+  const double half[3] = { light[0] / halfLength, light[1] / halfLength, (light[2] + 1) / halfLength };
+  int size = 1 << SURFACE_TABLE_BITS;
+  for (int y = 0; y < size; y++) {
+    for (int x = 0; x < size; x++) {
+      double east = (x - size / 2 + 0.5) / 8;
+      double south = (y - size / 2 + 0.5) / 8;
+      double length = sqrt(east * east + south * south + 1);
+      // The normal of the surface is (-east, -south, 1) / length
+      double diffuse = std::max(0.0, (-east * light[0] - south * light[1] + light[2]) / length);
+      double specular = pow(std::max(0.0, (-east * half[0] - south * half[1] + half[2]) / length), 40);
+      int level = std::min(COLOR_LEVELS - 1, (int)lround((6 + 36 * diffuse + 40 * specular) * COLOR_LEVELS / 64));
+      surfaceShading[(y << SURFACE_TABLE_BITS) + x] = shadeColor(NORMAL_PIXEL, true, level);
+    }
+  }
+  surfaceShadingScale = colorScale;
+}
+
+/*
+ * Selects a 16-bit color for a pixel that isn't a WALL_PIXEL from the slope of the surface u makes there, given as the differences
+ * between u at its neighbors to the east and west, and to the south and north. The slopes are scaled along with the color scale,
+ * so that the steepest waves that colorize() would show at full intensity nearly reach the edges of the table.
+ */
+static inline uint16_t shadeSurface(uint8_t pixelStatus, int32_t eastSlope, int32_t southSlope) {
+  const int32_t limit = 1 << (SURFACE_TABLE_BITS - 1);
+  uint8_t slopeBitShift = colorBitShift + 1;
+  int32_t x = std::min(std::max(eastSlope >> slopeBitShift, -limit), limit - 1) + limit;
+  int32_t y = std::min(std::max(southSlope >> slopeBitShift, -limit), limit - 1) + limit;
+  return tintColor(pixelStatus, surfaceShading[(y << SURFACE_TABLE_BITS) + x]);
+}
+
+#if FIELD_STATISTICS
+/*
+ * Adds the values of u from column first up to but not including column last of a row to the statistics of a band. Called on each span
+ * straight after stepping it, while its new values are still in the cache, so the statistics need no sweep of their own.
+ */
+void measureSpan(FieldStatistics *statistics, const field_t *row, int first, int last) {
+  int32_t maxAmplitude = statistics->maxAmplitude;
+  uint64_t sumOfSquares = statistics->sumOfSquares;
+  for (int j = first; j < last; j++) {
+    int32_t amplitude = row[j] < 0 ? -row[j] : row[j];
+    maxAmplitude = std::max(maxAmplitude, amplitude);
+    uint32_t scaled = amplitude >> STATISTICS_BIT_SHIFT;
+    sumOfSquares += scaled * scaled;
+    statistics->histogram[amplitude == 0 ? 0 : 32 - __builtin_clz(amplitude)]++;
+  }
+  statistics->pixelCount += last - first;
+  statistics->maxAmplitude = maxAmplitude;
+  statistics->sumOfSquares = sumOfSquares;
+}
+
+/*
+ * Adds up the statistics gathered by each band during a rendered step into fieldStatistics.
+ */
+void gatherFieldStatistics() {
+  memset(&fieldStatistics, 0, sizeof(fieldStatistics));
+  for (int b = 0; b < bandCount; b++) {
+    const FieldStatistics *statistics = &bands[b].statistics;
+    fieldStatistics.pixelCount += statistics->pixelCount;
+    fieldStatistics.maxAmplitude = std::max(fieldStatistics.maxAmplitude, statistics->maxAmplitude);
+    fieldStatistics.sumOfSquares += statistics->sumOfSquares;
+    for (int bucket = 0; bucket < AMPLITUDE_HISTOGRAM_BUCKETS; bucket++) {
+      fieldStatistics.histogram[bucket] += statistics->histogram[bucket];
+    }
+  }
+}
+#endif
+
+#if AUTO_GAIN
+/*
+ * Moves colorBitShift one bit towards the shift that brings all but the loudest AUTO_GAIN_PERCENTILE percent of the moving pixels measured
+ * by the last rendered step within the 64 levels of the color scale. Moving one bit per rendered step keeps the colors from flickering.
+ */
+void updateColorBitShift() {
+  uint32_t moving = fieldStatistics.pixelCount - fieldStatistics.histogram[0];
+  if (moving == 0) {
+    return;
+  }
+  // Find the number of significant bits that is enough for all but the allowed number of moving pixels
+  uint32_t allowed = moving * AUTO_GAIN_PERCENTILE / 100;
+  uint32_t louder = 0;
+  int bits = AMPLITUDE_HISTOGRAM_BUCKETS - 1;
+  while (bits > 1 && louder + fieldStatistics.histogram[bits] <= allowed) {
+    louder += fieldStatistics.histogram[bits];
+    bits--;
+  }
+  // Magnitudes of that many bits shifted right by bits - 6 are at most 63. Beyond the largest shift even the cap of u would be darkened.
+  int largestShift = 32 - __builtin_clz(-MIN_RANGE) - 6;
+  int target = std::min(std::max(bits - 6, COLOR_BIT_SHIFT - AUTO_GAIN_MAX_BOOST_BITS), largestShift);
+  if (target > colorBitShift) {
+    colorBitShift++;
+  } else if (target < colorBitShift) {
+    colorBitShift--;
+  }
+}
+#endif
+
+/*
+ * Returns the pixel type whose colors a GRADED pixel is drawn with: GLASS where waves are slowed down, ABSORBANT where they are damped more than usual.
+ */
+uint8_t gradedPixelAppearance(int index) {
+  if (waveSpeedSquared[index] < NORMAL_WAVE_SPEED_SQUARED) {
+    return GLASS_PIXEL;
+  }
+  return dampingRate[index] > NORMAL_DAMPING_RATE ? ABSORBANT_PIXEL : NORMAL_PIXEL;
+}
+
+/*
+ * Returns the amplitude of a SOURCE pixel at the given phase (a full turn being 2^32), interpolating linearly between entries of the sine table.
+ */
+int32_t sourceAmplitude(uint32_t phase) {
+  uint32_t entry = phase >> (32 - SINE_TABLE_BITS);
+  int32_t fraction = (phase >> (16 - SINE_TABLE_BITS)) & 0xFFFF;
+  int32_t below = sineTable[entry];
+  return below + (int32_t)(((int64_t)(sineTable[entry + 1] - below) * fraction) >> 16);
+}
+
+/*
+ * Sets u for every SOURCE pixel to its amplitude for the current step, then colors them if render is set.
+ * Runs after the rest of the field has been stepped, so neighboring pixels see the amplitudes from the previous step.
+ */
+void applySources(bool render) {
+  for (const SourcePixel *source = sources; source < sources + sourceCount; source++) {
+    int32_t amplitude = sourceAmplitude(source->phaseOffset + loopCounter * source->phaseIncrement);
+    u[source->index] = amplitude;
+    if (render) {
+      fieldImage[source->index] = colorize(NORMAL_PIXEL, amplitude);
+    }
+  }
+}
+
+/*
+ * Returns the next value of an OPEN_BOUNDARY pixel (see applyOpenBoundary()) from the next value of its inner neighbor and its own last value,
+ * and keeps the neighbor's value for the step after.
+ */
+static inline int32_t stepBoundaryPixel(BoundaryPixel *pixel, int32_t neighborU, int32_t lastU) {
+  int32_t value = pixel->neighborU - (int32_t)(((int64_t)(neighborU - lastU) * OPEN_BOUNDARY_COEFFICIENT) >> 16);
+  pixel->neighborU = neighborU;
+  return applyCap(value);
+}
+
+/*
+ * Sets u for every OPEN_BOUNDARY pixel from the one-way wave equation u_t = -c u_n (Mur's first-order absorbing boundary condition),
+ * discretized as u' = n + k (n' - u), where n is the inner neighbor, primes mark values after the step, and k = (c - 1) / (c + 1).
+ * This lets outgoing waves through with little reflection from a layer one pixel thick. Runs after the rest of the field has been stepped.
+ * Nonzero OPEN_BOUNDARY pixels keep their tiles awake, since the tiles next to them are not otherwise disturbed.
+ */
+void applyOpenBoundary(bool render) {
+  for (BoundaryPixel *pixel = boundary; pixel < boundary + boundaryCount; pixel++) {
+    // With LEAPFROG_STEP, u and v have already been swapped, so the pixel's value from the last step is in v
+    int32_t value = stepBoundaryPixel(pixel, u[pixel->neighbor], (LEAPFROG_STEP ? v : u)[pixel->index]);
+    u[pixel->index] = value;
+    if (value != 0) {
+      int i = pixel->index / fieldStride;
+      int j = pixel->index % fieldStride;
+      tileNonZero[i / TILE_HEIGHT][j / TILE_WIDTH] = 1;
+    }
+    if (render) {
+      // Drawn with the ABSORBANT tint so the edge of the field stays visible
+      fieldImage[pixel->index] = colorize(ABSORBANT_PIXEL, value);
+    }
+  }
+}
+
+/*
+ * Fills in the image array from fieldImage when the field is simulated at a reduced resolution, repeating each cell over its block of
+ * fieldScale x fieldScale pixels (nearest neighbor scaling). Each row of cells is expanded once and then copied to the remaining rows of its block.
+ * Blocks are cut short at the edges of the grid, as in reduceField(). At full resolution this only drops the padding from the end of each row.
+ */
+void scaleUpImage() {
+  for (int i = 0; i < fieldHeight; i++) {
+    const uint16_t *cells = fieldImage + toIndex(i, 0);
+    uint16_t *row = image + i * fieldScale * gridWidth;
+    if (fieldScale == 1) {
+      memcpy(row, cells, gridWidth * sizeof(uint16_t));
+      continue;
+    }
+    int wholeCells = gridWidth / fieldScale;
+    for (int j = 0; j < wholeCells; j++) {
+      for (int l = 0; l < fieldScale; l++) {
+        row[j * fieldScale + l] = cells[j];
+      }
+    }
+    for (int pixel = wholeCells * fieldScale; pixel < gridWidth; pixel++) {
+      row[pixel] = cells[wholeCells];
+    }
+    int blockHeight = std::min(fieldScale, gridHeight - i * fieldScale);
+    for (int k = 1; k < blockHeight; k++) {
+      memcpy(row + k * gridWidth, row, gridWidth * sizeof(uint16_t));
+    }
+  }
+}
+
+#if !LEAPFROG_STEP
+/*
+ * Reference implementation of one simulation step: two full passes over the grid, the first updating v from u
+ * and the second updating u from v and filling in the image array. Kept for frame time comparison (FUSED_WAVE_STEP 0).
+ */
+void stepFieldTwoPass() {
+
+  // First CPU-intensive loop: update values in v based on values in u given the wave equation:
+  // d2u/dt2 = c * c * (d2x/dt2 + d2y/dt2) - k * du/dt
+  // where d2u/dt2 is second partial time derivative, d2u/dx2 and d2u/dy2 are second partial space derivatives with respect to x and y,
+  // c is constant wave speed through the medium (same for regions with NORMAL and ABSORBANT pixels, slower for areas with GLASS pixels),
+  // and k is a damping constant close to zero except in regions with pixels of type IMEPEDANCE_PIXEL.
+  for (int i = 0; i < fieldHeight; i++) {
+    for (int index = toIndex(i, 0); index < toIndex(i, fieldWidth); index++) {
+      uint8_t pixelStatus = pixelType[index];
+      if (pixelStatus == NORMAL_PIXEL || pixelStatus == ABSORBANT_PIXEL || pixelStatus == GLASS_PIXEL) {
+        // Wave equation applies to normal, absorbant, and glass pixels
+        int32_t uCen = u[index];
+        int32_t uNorth = u[index - fieldStride];
+        int32_t uSouth = u[index + fieldStride];
+        int32_t uEast = u[index + 1];
+        int32_t uWest = u[index - 1];
+        int32_t uxx = ((uWest + uEast) >> 1) - uCen;
+        int32_t uyy = ((uNorth + uSouth) >> 1) - uCen;
+        int32_t vel = v[index] + (uxx >> 1) + (uyy >> 1);
+        // Velocity is damped lightly for normal and glass pixels, heavily for absorbant pixels
+        vel -= (vel >> (pixelStatus == ABSORBANT_PIXEL ? absorbantDampingBitShift : normalDampingBitShift));
+        v[index] = applyCap(vel);
+      } else if (pixelStatus == GRADED_PIXEL) {
+        int32_t uCen = u[index];
+        int32_t uxx = ((u[index - 1] + u[index + 1]) >> 1) - uCen;
+        int32_t uyy = ((u[index - fieldStride] + u[index + fieldStride]) >> 1) - uCen;
+        int32_t vel = v[index] + (uxx >> 1) + (uyy >> 1);
+        vel -= (int32_t)(((int64_t)vel * dampingRate[index]) >> DAMPING_RATE_BITS);
+        v[index] = applyCap(vel);
+      }
+    }
+  }
+
+  // Second CPU-intensive loop: update each value in u based on its corresponding value in v given that v=du/dt, using one loop interval as dt.
+  // Then, calculate a 16-bit color value for image, based on the value in u. SOURCE pixels are set afterwards by applySources().
+  for (int i = 0; i < fieldHeight; i++) {
+    for (int index = toIndex(i, 0); index < toIndex(i, fieldWidth); index++) {
+      uint8_t pixelStatus = pixelType[index];
+      // WALL_PIXEL: can be skipped (u = 0, v = 0).
+      if (pixelStatus == NORMAL_PIXEL || pixelStatus == ABSORBANT_PIXEL) {
+        // NORMAL_PIXEL and ABSORBANT_PIXEL: update u by adding an amount proportional to v. (Using loop interval as dt, proportionality constant is 1.0.)
+        u[index] = applyCap(u[index] + v[index]);
+      } else if (pixelStatus == GLASS_PIXEL) {
+        // GLASS_PIXEL: Using 2.0 as index of refraction for glass implies a wave speed of 0.5, so the proportionality constant is 0.25, obtainable by shifting right 2 bits.
+        u[index] = applyCap(u[index] + (v[index] >> GLASS_REFRACTION_BIT_SHIFT));
+      } else if (pixelStatus == GRADED_PIXEL) {
+        // GRADED_PIXEL: the proportionality constant is the square of the wave speed at this pixel
+        u[index] = applyCap(u[index] + (int32_t)(((int64_t)v[index] * waveSpeedSquared[index]) >> WAVE_SPEED_SQUARED_BITS));
+        pixelStatus = gradedPixelAppearance(index);
+      }
+
+      // Second part of loop body- select a 16-bit color to put in image array
+      fieldImage[index] = colorize(pixelStatus, u[index]);
+    }
+  }
+  applyOpenBoundary(true);
+  applySources(true);
+  if (fieldImage != image) {
+    scaleUpImage();
+  }
+#if FIELD_STATISTICS
+  // As the reference version, this measures the stepped pixels in a sweep of its own
+  if (renderedStepCount++ % statisticsInterval == 0) {
+    memset(&fieldStatistics, 0, sizeof(fieldStatistics));
+    for (int i = 0; i < fieldHeight; i++) {
+      for (const MaterialSpan *span = spans + rowFirstSpan[i]; span < spans + rowFirstSpan[i + 1]; span++) {
+        if (span->type == NORMAL_PIXEL || span->type == ABSORBANT_PIXEL || span->type == GLASS_PIXEL || span->type == GRADED_PIXEL) {
+          measureSpan(&fieldStatistics, u + toIndex(i, 0), span->start, span->end);
+        }
+      }
+    }
+#if AUTO_GAIN
+    updateColorBitShift();
+#endif
+  }
+#endif
+}
+#endif
+
+/*
+ * On steps that sample the intensity, moves the average intensity of the pixel at index towards the square of its new value of u, pos.
+ * u is scaled to 8 bits by the shift colorize() would use less two bits before squaring, so the average keeps to 16 bits and follows AUTO_GAIN.
+ * Called by the span kernels for each pixel they step in INTENSITY_VIEW, straight after working out pos. The averages in a tile that has gone
+ * quiet are left alone, since by the time every value of u in it has decayed to zero, they are far too small to show.
+ */
+template <uint8_t VIEW>
+static inline void sampleIntensityPixel(int index, int32_t pos) {
+#if INTENSITY_AVERAGE
+  if (VIEW == INTENSITY_VIEW && sampleIntensity) {
+    int32_t amplitude = std::min((pos < 0 ? -pos : pos) >> (colorBitShift - 2), 255);
+    intensity[index] += (amplitude * amplitude - intensity[index]) >> INTENSITY_AVERAGE_BIT_SHIFT;
+  }
+#else
+  (void)index;
+  (void)pos;
+#endif
+}
+
+/*
+ * Draws the pixel at index, column j of the rows passed to the span kernels, in the view VIEW: as a shaded surface (see shadeSurface()),
+ * with the slope taken from the neighbors the stencil has just read, from its average intensity, or from its new value of u, pos.
+ */
+template <uint8_t VIEW>
+static inline void renderPixel(uint8_t appearance, int index, int j, int32_t pos, const field_t *northRow, const field_t *centerRow, const field_t *southRow) {
+  if (VIEW == SURFACE_VIEW) {
+    fieldImage[index] = shadeSurface(appearance, centerRow[j + 1] - centerRow[j - 1], southRow[j] - northRow[j]);
+#if INTENSITY_AVERAGE
+  } else if (VIEW == INTENSITY_VIEW) {
+    fieldImage[index] = colorizeIntensity(appearance, intensity[index]);
+#endif
+  } else {
+    fieldImage[index] = colorize(appearance, pos);
+  }
+}
+
+#if LEAPFROG_STEP
+
+/*
+ * Returns approximately one third of x, as (x >> 2) + (x >> 4) + (x >> 6) + (x >> 8), which is 0.332 x.
+ */
+static inline int32_t oneThird(int32_t x) {
+  return (x >> 2) + (x >> 4) + (x >> 6) + (x >> 8);
+}
+
+/*
+ * Returns the Laplacian term of the step at column j of centerRow, i.e. the Laplacian times the square of the wave speed (1/4).
+ * This is the five point stencil ((uxx + uyy) / 2), or with ISOTROPIC_LAPLACIAN, two thirds of it plus one third of the same stencil
+ * rotated onto the diagonals ((uxy + uyx) / 4, where the neighbors are sqrt(2) pixels apart). The errors of the two stencils depend
+ * on direction in opposite ways, and cancel in that ratio, so circular waves stay circular down to a few pixels per wavelength.
+ */
+static inline int32_t laplacianTerm(const field_t *northRow, const field_t *centerRow, const field_t *southRow, int j) {
+  int32_t uCen = centerRow[j];
+  int32_t uxx = ((centerRow[j - 1] + centerRow[j + 1]) >> 1) - uCen;
+  int32_t uyy = ((northRow[j] + southRow[j]) >> 1) - uCen;
+  int32_t laplacian = (uxx >> 1) + (uyy >> 1);
+#if ISOTROPIC_LAPLACIAN
+  int32_t uxy = ((northRow[j + 1] + southRow[j - 1]) >> 1) - uCen;
+  int32_t uyx = ((northRow[j - 1] + southRow[j + 1]) >> 1) - uCen;
+  laplacian -= oneThird(laplacian - ((uxy >> 2) + (uyx >> 2)));
+#endif
+  return laplacian;
+}
+
+#if STENCIL_VECTOR_WIDTH > 1
+/*
+ * Vector version of laplacianTerm() for STENCIL_VECTOR_WIDTH pixels starting at column j, giving exactly the same results.
+ */
+static inline StencilVector laplacianVector(const field_t *northRow, const field_t *centerRow, const field_t *southRow, int j) {
+  StencilVector uCen = loadVector(centerRow + j);
+  StencilVector uxx = subtractVectors(shiftVector(addVectors(loadVector(centerRow + j - 1), loadVector(centerRow + j + 1)), 1), uCen);
+  StencilVector uyy = subtractVectors(shiftVector(addVectors(loadVector(northRow + j), loadVector(southRow + j)), 1), uCen);
+  StencilVector laplacian = addVectors(shiftVector(uxx, 1), shiftVector(uyy, 1));
+#if ISOTROPIC_LAPLACIAN
+  StencilVector uxy = subtractVectors(shiftVector(addVectors(loadVector(northRow + j + 1), loadVector(southRow + j - 1)), 1), uCen);
+  StencilVector uyx = subtractVectors(shiftVector(addVectors(loadVector(northRow + j - 1), loadVector(southRow + j + 1)), 1), uCen);
+  StencilVector difference = subtractVectors(laplacian, addVectors(shiftVector(uxy, 2), shiftVector(uyx, 2)));
+  StencilVector third = addVectors(addVectors(shiftVector(difference, 2), shiftVector(difference, 4)), addVectors(shiftVector(difference, 6), shiftVector(difference, 8)));
+  laplacian = subtractVectors(laplacian, third);
+#endif
+  return laplacian;
+}
+#endif
+
+/*
+ * Leapfrog version of stepWaveSpan(): v holds the values of u from the previous step instead of its rate of change, and nextRow (a row of v)
+ * is overwritten with the values for the next step, so the other rows passed in are rows of u itself, which is not written until u and v are swapped.
+ * Since the explicit version's v is the last change in u, uNext = u + (1 - k) ((u - uPrevious) + L) where L is the Laplacian term and k the damping:
+ * the same arithmetic, so NORMAL and ABSORBANT pixels give identical results as long as nothing reaches the cap.
+ * GLASS pixels scale the Laplacian term instead of the change in u, which only differs from the explicit version in the rounding.
+ * Rendered pixels are drawn in the view VIEW (see renderPixel()), and in INTENSITY_VIEW the intensity is sampled as well (see sampleIntensityPixel()).
+ * Returns the bitwise OR of the old and new values of u, which is nonzero if anything in the span is still moving.
+ */
+template <uint8_t PIXEL_TYPE, bool RENDER, uint8_t VIEW>
+int32_t stepWaveSpan(int first, int last, int rowStart, const field_t *northRow, const field_t *centerRow, const field_t *southRow, field_t *nextRow) {
+  uint8_t dampingBitShift = PIXEL_TYPE == ABSORBANT_PIXEL ? absorbantDampingBitShift : normalDampingBitShift;
+  int32_t activity = 0;
+  int j = first;
+
+#if STENCIL_VECTOR_WIDTH > 1
+  StencilVector vectorActivity = zeroVector();
+  for (; j + STENCIL_VECTOR_WIDTH <= last; j += STENCIL_VECTOR_WIDTH) {
+    StencilVector uCen = loadVector(centerRow + j);
+    StencilVector laplacian = laplacianVector(northRow, centerRow, southRow, j);
+    StencilVector change = addVectors(subtractVectors(uCen, loadVector(nextRow + j)), PIXEL_TYPE == GLASS_PIXEL ? shiftVector(laplacian, GLASS_REFRACTION_BIT_SHIFT) : laplacian);
+    change = subtractVectors(change, shiftVector(change, dampingBitShift));
+    StencilVector pos = capVector(addVectors(uCen, change));
+    storeVector(nextRow + j, pos);
+    vectorActivity = orVectors(vectorActivity, orVectors(uCen, pos));
+  }
+  activity = orLanes(vectorActivity);
+  if (RENDER || VIEW == INTENSITY_VIEW) {
+    for (int k = first; k < j; k++) {
+      sampleIntensityPixel<VIEW>(rowStart + k, nextRow[k]);
+      if (RENDER) {
+        renderPixel<VIEW>(PIXEL_TYPE, rowStart + k, k, nextRow[k], northRow, centerRow, southRow);
+      }
+    }
+  }
+#endif
+
+  for (; j < last; j++) {
+    int index = rowStart + j;
+    int32_t uCen = centerRow[j];
+    int32_t laplacian = laplacianTerm(northRow, centerRow, southRow, j);
+    int32_t change = (uCen - nextRow[j]) + (PIXEL_TYPE == GLASS_PIXEL ? laplacian >> GLASS_REFRACTION_BIT_SHIFT : laplacian);
+    change -= (change >> dampingBitShift);
+    int32_t pos = applyCap(uCen + change);
+    nextRow[j] = pos;
+    sampleIntensityPixel<VIEW>(index, pos);
+    if (RENDER) {
+      renderPixel<VIEW>(PIXEL_TYPE, index, j, pos, northRow, centerRow, southRow);
+    }
+    activity |= uCen | pos;
+  }
+  return activity;
+}
+
+/*
+ * Leapfrog version of stepGradedSpan(), with each pixel's own square of the wave speed scaling the Laplacian and its damping rate scaling the change in u.
+ */
+template <bool RENDER, uint8_t VIEW>
+int32_t stepGradedSpan(int first, int last, int rowStart, const field_t *northRow, const field_t *centerRow, const field_t *southRow, field_t *nextRow) {
+  int32_t activity = 0;
+  for (int j = first; j < last; j++) {
+    int index = rowStart + j;
+    int32_t uCen = centerRow[j];
+    int32_t laplacian = laplacianTerm(northRow, centerRow, southRow, j);
+    int32_t change = (uCen - nextRow[j]) + (int32_t)(((int64_t)laplacian * waveSpeedSquared[index]) >> WAVE_SPEED_SQUARED_BITS);
+    change -= (int32_t)(((int64_t)change * dampingRate[index]) >> DAMPING_RATE_BITS);
+    int32_t pos = applyCap(uCen + change);
+    nextRow[j] = pos;
+    sampleIntensityPixel<VIEW>(index, pos);
+    if (RENDER) {
+      renderPixel<VIEW>(gradedPixelAppearance(index), index, j, pos, northRow, centerRow, southRow);
+    }
+    activity |= uCen | pos;
+  }
+  return activity;
+}
+
+#else
+
+/*
+ * Steps the NORMAL, ABSORBANT, or GLASS pixels (depending on PIXEL_TYPE) from column first up to but not including column last of the row starting at rowStart,
+ * then colors them if RENDER is set. velocityRow is the same row of v. Specialized for each material so the inner loop has no branches on pixel type.
+ * Where the target has a vector implementation (see STENCIL_VECTOR_WIDTH), STENCIL_VECTOR_WIDTH pixels at a time are stepped with vector instructions
+ * before the scalar loop finishes off the remainder; both give exactly the same results.
+ * Rendered pixels are drawn in the view VIEW (see renderPixel()), and in INTENSITY_VIEW the intensity is sampled as well (see sampleIntensityPixel()).
+ * Returns the bitwise OR of the new values of u and v, which is nonzero if anything in the span is still moving.
+ */
+template <uint8_t PIXEL_TYPE, bool RENDER, uint8_t VIEW>
+int32_t stepWaveSpan(int first, int last, int rowStart, const field_t *northRow, const field_t *centerRow, const field_t *southRow, field_t *velocityRow) {
+  uint8_t dampingBitShift = PIXEL_TYPE == ABSORBANT_PIXEL ? absorbantDampingBitShift : normalDampingBitShift;
+  int32_t activity = 0;
+  int j = first;
+
+#if STENCIL_VECTOR_WIDTH > 1
+  StencilVector vectorActivity = zeroVector();
+  for (; j + STENCIL_VECTOR_WIDTH <= last; j += STENCIL_VECTOR_WIDTH) {
+    int index = rowStart + j;
+    StencilVector uCen = loadVector(centerRow + j);
+    StencilVector uxx = subtractVectors(shiftVector(addVectors(loadVector(centerRow + j - 1), loadVector(centerRow + j + 1)), 1), uCen);
+    StencilVector uyy = subtractVectors(shiftVector(addVectors(loadVector(northRow + j), loadVector(southRow + j)), 1), uCen);
+    StencilVector vel = addVectors(addVectors(loadVector(velocityRow + j), shiftVector(uxx, 1)), shiftVector(uyy, 1));
+    vel = capVector(subtractVectors(vel, shiftVector(vel, dampingBitShift)));
+    storeVector(velocityRow + j, vel);
+    StencilVector pos = capVector(addVectors(uCen, PIXEL_TYPE == GLASS_PIXEL ? shiftVector(vel, GLASS_REFRACTION_BIT_SHIFT) : vel));
+    storeVector(u + index, pos);
+    vectorActivity = orVectors(vectorActivity, orVectors(vel, pos));
+  }
+  activity = orLanes(vectorActivity);
+  if (RENDER || VIEW == INTENSITY_VIEW) {
+    for (int k = first; k < j; k++) {
+      sampleIntensityPixel<VIEW>(rowStart + k, u[rowStart + k]);
+      if (RENDER) {
+        renderPixel<VIEW>(PIXEL_TYPE, rowStart + k, k, u[rowStart + k], northRow, centerRow, southRow);
+      }
+    }
+  }
+#endif
+
+  for (; j < last; j++) {
+    int index = rowStart + j;
+    int32_t uCen = centerRow[j];
+    int32_t uxx = ((centerRow[j - 1] + centerRow[j + 1]) >> 1) - uCen;
+    int32_t uyy = ((northRow[j] + southRow[j]) >> 1) - uCen;
+    int32_t vel = velocityRow[j] + (uxx >> 1) + (uyy >> 1);
+    vel -= (vel >> dampingBitShift);
+    vel = applyCap(vel);
+    velocityRow[j] = vel;
+    int32_t pos = applyCap(uCen + (PIXEL_TYPE == GLASS_PIXEL ? vel >> GLASS_REFRACTION_BIT_SHIFT : vel));
+    u[index] = pos;
+    sampleIntensityPixel<VIEW>(index, pos);
+    if (RENDER) {
+      renderPixel<VIEW>(PIXEL_TYPE, index, j, pos, northRow, centerRow, southRow);
+    }
+    activity |= vel | pos;
+  }
+  return activity;
+}
+
+/*
+ * Steps the GRADED pixels from column first up to but not including column last of the row starting at rowStart, then colors them if RENDER is set.
+ * Works like stepWaveSpan() but multiplies by each pixel's own coefficients instead of shifting, so that any wave speed and damping can be set.
+ */
+template <bool RENDER, uint8_t VIEW>
+int32_t stepGradedSpan(int first, int last, int rowStart, const field_t *northRow, const field_t *centerRow, const field_t *southRow, field_t *velocityRow) {
+  int32_t activity = 0;
+  for (int j = first; j < last; j++) {
+    int index = rowStart + j;
+    int32_t uCen = centerRow[j];
+    int32_t uxx = ((centerRow[j - 1] + centerRow[j + 1]) >> 1) - uCen;
+    int32_t uyy = ((northRow[j] + southRow[j]) >> 1) - uCen;
+    int32_t vel = velocityRow[j] + (uxx >> 1) + (uyy >> 1);
+    vel -= (int32_t)(((int64_t)vel * dampingRate[index]) >> DAMPING_RATE_BITS);
+    vel = applyCap(vel);
+    velocityRow[j] = vel;
+    int32_t pos = applyCap(uCen + (int32_t)(((int64_t)vel * waveSpeedSquared[index]) >> WAVE_SPEED_SQUARED_BITS));
+    u[index] = pos;
+    sampleIntensityPixel<VIEW>(index, pos);
+    if (RENDER) {
+      renderPixel<VIEW>(gradedPixelAppearance(index), index, j, pos, northRow, centerRow, southRow);
+    }
+    activity |= vel | pos;
+  }
+  return activity;
+}
+
+#endif
+
+/*
+ * Recolors a whole tile from the current values of u, as the view being drawn would. Used for tiles that were stepped without being rendered
+ * and have since gone quiet.
+ */
+void colorizeTile(int tileRow, int tileColumn) {
+  int firstColumn = tileColumn * TILE_WIDTH;
+  int lastColumn = std::min(firstColumn + TILE_WIDTH, fieldWidth);
+  int lastRow = std::min((tileRow + 1) * TILE_HEIGHT, fieldHeight);
+  for (int i = tileRow * TILE_HEIGHT; i < lastRow; i++) {
+    for (const MaterialSpan *span = spans + rowFirstSpan[i]; span < spans + rowFirstSpan[i + 1] && span->start < lastColumn; span++) {
+      if (span->end <= firstColumn || span->type == WALL_PIXEL) {
+        continue;
+      }
+      int last = std::min((int)span->end, lastColumn);
+      // Only the stepped materials are drawn as a surface, since they never sit on the edge of the field where some neighbors are missing
+      bool shaded = fieldView == SURFACE_VIEW && (span->type == NORMAL_PIXEL || span->type == ABSORBANT_PIXEL || span->type == GLASS_PIXEL || span->type == GRADED_PIXEL);
+      for (int index = toIndex(i, std::max((int)span->start, firstColumn)); index < toIndex(i, last); index++) {
+        uint8_t appearance = span->type == GRADED_PIXEL ? gradedPixelAppearance(index) : span->type;
+#if INTENSITY_AVERAGE
+        if (fieldView == INTENSITY_VIEW) {
+          fieldImage[index] = colorizeIntensity(appearance, intensity[index]);
+          continue;
+        }
+#endif
+        if (shaded) {
+          fieldImage[index] = shadeSurface(appearance, u[index + 1] - u[index - 1], u[index + fieldStride] - u[index - fieldStride]);
+        } else {
+          fieldImage[index] = colorize(appearance, u[index]);
+        }
+      }
+    }
+  }
+}
+
+/*
+ * Copies the pre-step values of u that a band needs from rows owned by its neighbors: the row above the band goes into its
+ * north line buffer, and the first row of the band below goes into its south halo. Every band does this before any band starts stepping.
+ * Does nothing with LEAPFROG_STEP, where u is not written during the step.
+ */
+void captureBandHalos(SolverBand *band) {
+#if LEAPFROG_STEP
+  (void)band;
+#else
+  int firstRow = band->firstTileRow * TILE_HEIGHT;
+  int lastRow = std::min(band->lastTileRow * TILE_HEIGHT, fieldHeight);
+  // Element 0 and element fieldWidth + 1 of each line buffer are zero guards, so pixel j of a row lives at element j + 1.
+  // Above row 0 this copies the guard row of zeros in the field arena
+  memcpy(band->lineBuffer[0] + 1, u + toIndex(firstRow - 1, 0), fieldWidth * sizeof(field_t));
+  if (lastRow < fieldHeight) {
+    memcpy(band->southHalo, u + toIndex(lastRow, 0), fieldWidth * sizeof(field_t));
+  }
+#endif
+}
+
+/*
+ * Fused version of stepFieldTwoPass() for one band, making a single sweep over its rows.
+ * Before a row is updated its old values of u are copied into a line buffer, so the stencil can keep reading pre-step values
+ * for the row above (already updated in memory) and for the west neighbor (already updated earlier in the same row).
+ * The row below has not been touched yet and is read directly from u, or from the south halo for the last row of the band.
+ * Each row is processed as the list of material spans built by compileSpans(), clipped to the active tiles.
+ * The image array is only updated if RENDER is set; tiles stepped without being rendered are marked stale, and recolored
+ * by the next rendered step even if they are not active by then.
+ * FEATURES lists the materials besides NORMAL pixels that need stepping (see fieldFeatures); spans of any other material are left alone,
+ * so the checks for materials a mode does not use are compiled out of the loop over spans.
+ * VIEW is the view being drawn (see setFieldView()). In INTENSITY_VIEW, the span kernels also update the average intensity of each pixel
+ * as they step it on steps that sample it, and draw that instead of u.
+ */
+template <bool RENDER, uint8_t FEATURES, uint8_t VIEW>
+void stepBand(SolverBand *band) {
+#if LEAPFROG_STEP
+  const field_t *northRow = NULL;
+  const field_t *centerRow = NULL;
+#else
+  field_t *northRow = band->lineBuffer[0] + 1;
+  field_t *centerRow = band->lineBuffer[1] + 1;
+#endif
+
+#if FIELD_STATISTICS
+  if (RENDER && measureStep) {
+    memset(&band->statistics, 0, sizeof(FieldStatistics));
+  }
+#endif
+
+  for (int tileRow = band->firstTileRow; tileRow < band->lastTileRow; tileRow++) {
+    uint8_t *active = tileActive[tileRow];
+    int32_t *tileActivity = band->tileActivity;
+    memset(tileActivity, 0, tileColumns * sizeof(int32_t));
+    int firstRow = tileRow * TILE_HEIGHT;
+    int lastRow = std::min(firstRow + TILE_HEIGHT, fieldHeight);
+
+    // Inactive tiles were all zero at the end of the last step and have no active neighbors, so stepping them would leave them unchanged.
+    // Where the tile above was skipped, the row above was not updated either, so its old values of u can be read straight from memory.
+    // (The row above the first tile row of the band is already in the north line buffer.)
+    if (!LEAPFROG_STEP && tileRow > band->firstTileRow) {
+      for (int tileColumn = 0; tileColumn < tileColumns; tileColumn++) {
+        if (active[tileColumn] && !tileActive[tileRow - 1][tileColumn]) {
+          int firstColumn = tileColumn * TILE_WIDTH;
+          int lastColumn = std::min(firstColumn + TILE_WIDTH, fieldWidth);
+          memcpy((field_t*)northRow + firstColumn, u + toIndex(firstRow - 1, firstColumn), (lastColumn - firstColumn) * sizeof(field_t));
+        }
+      }
+    }
+
+    for (int i = firstRow; i < lastRow; i++) {
+      int rowStart = i * fieldStride;
+#if LEAPFROG_STEP
+      // The stencil reads u directly, as only v is written during the step. Stepped pixels never sit on the edge of the field,
+      // so the rows and columns either side of them are always in u.
+      northRow = u + rowStart - fieldStride;
+      centerRow = u + rowStart;
+      const field_t *southRow = u + rowStart + fieldStride;
+#else
+      // Only dereferenced for NORMAL, ABSORBANT, and GLASS pixels, which never sit on the bottom row
+      const field_t *southRow = (i == lastRow - 1 && tileRow == band->lastTileRow - 1 && lastRow < fieldHeight) ? band->southHalo : u + rowStart + fieldStride;
+#endif
+
+      const MaterialSpan *span = spans + rowFirstSpan[i];
+      const MaterialSpan *rowEnd = spans + rowFirstSpan[i + 1];
+
+#if !LEAPFROG_STEP
+      // Save old values of u for every active tile, plus one column either side, before any of them are updated
+      for (int tileColumn = 0; tileColumn < tileColumns; tileColumn++) {
+        if (active[tileColumn]) {
+          int firstColumn = std::max(tileColumn * TILE_WIDTH - 1, 0);
+          int lastColumn = std::min((tileColumn + 1) * TILE_WIDTH + 1, fieldWidth);
+          memcpy(centerRow + firstColumn, u + rowStart + firstColumn, (lastColumn - firstColumn) * sizeof(field_t));
+        }
+      }
+#endif
+
+      for (int tileColumn = 0; tileColumn < tileColumns; tileColumn++) {
+        if (!active[tileColumn]) {
+          continue;
+        }
+        int32_t activity = 0;
+        int tileFirstColumn = tileColumn * TILE_WIDTH;
+        int tileLastColumn = std::min(tileFirstColumn + TILE_WIDTH, fieldWidth);
+        // Spans are in column order, and so are the tiles, so the search for the first overlapping span carries on from the previous tile
+        while (span->end <= tileFirstColumn) {
+          span++;
+        }
+        for (const MaterialSpan *tileSpan = span; tileSpan < rowEnd && tileSpan->start < tileLastColumn; tileSpan++) {
+          int first = std::max((int)tileSpan->start, tileFirstColumn);
+          int last = std::min((int)tileSpan->end, tileLastColumn);
+          // WALL pixels never change, and were drawn into image by compileSpans().
+          // SOURCE and OPEN_BOUNDARY pixels are set by applySources() and applyOpenBoundary() once every band has been stepped.
+          uint8_t type = tileSpan->type;
+          if (type == NORMAL_PIXEL) {
+            activity |= stepWaveSpan<NORMAL_PIXEL, RENDER, VIEW>(first, last, rowStart, northRow, centerRow, southRow, v + rowStart);
+          } else if ((FEATURES & ABSORBANT_FEATURE) && type == ABSORBANT_PIXEL) {
+            activity |= stepWaveSpan<ABSORBANT_PIXEL, RENDER, VIEW>(first, last, rowStart, northRow, centerRow, southRow, v + rowStart);
+          } else if ((FEATURES & GLASS_FEATURE) && type == GLASS_PIXEL) {
+            activity |= stepWaveSpan<GLASS_PIXEL, RENDER, VIEW>(first, last, rowStart, northRow, centerRow, southRow, v + rowStart);
+          } else if ((FEATURES & GRADED_FEATURE) && type == GRADED_PIXEL) {
+            activity |= stepGradedSpan<RENDER, VIEW>(first, last, rowStart, northRow, centerRow, southRow, v + rowStart);
+          } else {
+            continue;
+          }
+#if FIELD_STATISTICS
+          if (RENDER && measureStep) {
+            // The new values of u are in v until the swap with LEAPFROG_STEP
+            measureSpan(&band->statistics, (LEAPFROG_STEP ? v : u) + rowStart, first, last);
+          }
+#endif
+        }
+        tileActivity[tileColumn] |= activity;
+      }
+
+#if !LEAPFROG_STEP
+      field_t *swap = northRow;
+      northRow = centerRow;
+      centerRow = swap;
+#endif
+    }
+
+    for (int tileColumn = 0; tileColumn < tileColumns; tileColumn++) {
+      // SOURCE pixels count as disturbances, so their neighbors get stepped too
+      tileNonZero[tileRow][tileColumn] = tileActivity[tileColumn] != 0 || tileHasSource[tileRow][tileColumn];
+      if (!RENDER) {
+        tileStale[tileRow][tileColumn] |= active[tileColumn];
+      } else if (tileStale[tileRow][tileColumn]) {
+        if (!active[tileColumn]) {
+          colorizeTile(tileRow, tileColumn);
+        }
+        tileStale[tileRow][tileColumn] = 0;
+      }
+    }
+  }
+}
+
+/*
+ * Steps one band with the version of stepBand() compiled for the materials in the field, or with SPECIALIZED_STEP set to 0,
+ * the version handling all of them.
+ */
+template <bool RENDER, uint8_t VIEW>
+void stepBandWithFeatures(SolverBand *band) {
+#if SPECIALIZED_STEP
+  switch (fieldFeatures) {
+    case 0:
+      stepBand<RENDER, 0, VIEW>(band);
+      break;
+    case ABSORBANT_FEATURE:
+      stepBand<RENDER, ABSORBANT_FEATURE, VIEW>(band);
+      break;
+    case GLASS_FEATURE:
+      stepBand<RENDER, GLASS_FEATURE, VIEW>(band);
+      break;
+    case ABSORBANT_FEATURE | GLASS_FEATURE:
+      stepBand<RENDER, ABSORBANT_FEATURE | GLASS_FEATURE, VIEW>(band);
+      break;
+    case GRADED_FEATURE:
+      stepBand<RENDER, GRADED_FEATURE, VIEW>(band);
+      break;
+    default:
+      stepBand<RENDER, ALL_FEATURES, VIEW>(band);
+      break;
+  }
+#else
+  stepBand<RENDER, ALL_FEATURES, VIEW>(band);
+#endif
+}
+
+/*
+ * Steps one band, rendering it or not depending on renderStep. Steps that are not rendered are the same in every view, except for those
+ * that sample the intensity, which only have the version of stepBand() handling every material to keep down the number of versions compiled.
+ */
+void stepBandForStep(SolverBand *band) {
+#if INTENSITY_AVERAGE
+  if (fieldView == INTENSITY_VIEW && (renderStep || sampleIntensity)) {
+    if (renderStep) {
+      stepBand<true, ALL_FEATURES, INTENSITY_VIEW>(band);
+    } else {
+      stepBand<false, ALL_FEATURES, INTENSITY_VIEW>(band);
+    }
+    return;
+  }
+#endif
+  if (!renderStep) {
+    stepBandWithFeatures<false, AMPLITUDE_VIEW>(band);
+  } else if (fieldView == SURFACE_VIEW) {
+    stepBandWithFeatures<true, SURFACE_VIEW>(band);
+  } else {
+    stepBandWithFeatures<true, AMPLITUDE_VIEW>(band);
+  }
+}
+
+#ifdef ESP_PLATFORM
+
+// Each band task sets bit (band) when its halos are captured and bit (band + 8) when it has finished stepping
+#define BAND_HALO_BIT(band) (1 << (band))
+#define BAND_DONE_BIT(band) (1 << ((band) + 8))
+#define BAND_TASK_PRIORITY 2
+
+TaskHandle_t bandTasks[MAX_SOLVER_BANDS];
+EventGroupHandle_t bandEvents = NULL;
+
+/*
+ * Body of the task for one band, pinned to its own core. Waits to be notified by stepFieldFused(), then captures its halos,
+ * waits at a barrier until every band has done the same, and steps its rows.
+ */
+void bandTask(void *parameter) {
+  SolverBand *band = (SolverBand*)parameter;
+  int bandIndex = band - bands;
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    captureBandHalos(band);
+    xEventGroupSync(bandEvents, BAND_HALO_BIT(bandIndex), (1 << bandCount) - 1, portMAX_DELAY);
+    stepBandForStep(band);
+    xEventGroupSetBits(bandEvents, BAND_DONE_BIT(bandIndex));
+  }
+}
+
+void runBands() {
+  for (int b = 0; b < bandCount; b++) {
+    xTaskNotifyGive(bandTasks[b]);
+  }
+  xEventGroupWaitBits(bandEvents, ((1 << bandCount) - 1) << 8, pdTRUE, pdTRUE, portMAX_DELAY);
+}
+
+// The tasks are created once and left idle when fewer bands are in use
+void stopBandWorkers() {
+}
+
+void startBandWorkers() {
+  if (bandEvents == NULL) {
+    bandEvents = xEventGroupCreate();
+    for (int b = 0; b < MAX_SOLVER_BANDS; b++) {
+      xTaskCreatePinnedToCore(bandTask, "band", 4096, &bands[b], BAND_TASK_PRIORITY, &bandTasks[b], b % portNUM_PROCESSORS);
+    }
+  }
+}
+
+#else
+
+/*
+ * Reusable barrier for the host build's band threads (std::barrier needs C++20).
+ */
+class BandBarrier {
+  public:
+    void reset(int count) {
+      parties = count;
+      waiting = 0;
+    }
+    void wait() {
+      std::unique_lock<std::mutex> lock(mutex);
+      int arrivedGeneration = generation;
+      if (++waiting == parties) {
+        waiting = 0;
+        generation++;
+        condition.notify_all();
+      } else {
+        condition.wait(lock, [&] { return generation != arrivedGeneration; });
+      }
+    }
+  private:
+    std::mutex mutex;
+    std::condition_variable condition;
+    int parties = 1;
+    int waiting = 0;
+    int generation = 0;
+};
+
+std::thread bandThreads[MAX_SOLVER_BANDS];
+int bandThreadCount = 0;
+// stepBarrier is shared with the thread calling stepFieldFused() to start and finish each step; haloBarrier is shared by the bands only
+BandBarrier stepBarrier, haloBarrier;
+bool stopBandThreads = false;
+
+void bandThread(SolverBand *band) {
+  for (;;) {
+    stepBarrier.wait();
+    if (stopBandThreads) {
+      return;
+    }
+    captureBandHalos(band);
+    haloBarrier.wait();
+    stepBandForStep(band);
+    stepBarrier.wait();
+  }
+}
+
+void runBands() {
+  stepBarrier.wait();
+  stepBarrier.wait();
+}
+
+void stopBandWorkers() {
+  if (bandThreadCount > 0) {
+    stopBandThreads = true;
+    stepBarrier.wait();
+    for (int b = 0; b < bandThreadCount; b++) {
+      bandThreads[b].join();
+    }
+    stopBandThreads = false;
+    bandThreadCount = 0;
+  }
+}
+
+void startBandWorkers() {
+  stopBandWorkers();
+  stepBarrier.reset(bandCount + 1);
+  haloBarrier.reset(bandCount);
+  for (int b = 0; b < bandCount; b++) {
+    bandThreads[b] = std::thread(bandThread, &bands[b]);
+  }
+  bandThreadCount = bandCount;
+}
+
+#endif
+
+/*
+ * Splits the field into the given number of horizontal bands of whole tile rows, and starts a worker for each one if there is more than one.
+ * On the ESP32-S3 the workers are FreeRTOS tasks pinned to alternate cores; on a host they are std::threads, which are
+ * stopped again by startSolverBands(1).
+ */
+void startSolverBands(int count) {
+  requestedBandCount = count;
+  bandCount = std::max(1, std::min(count, std::min(MAX_SOLVER_BANDS, tileRows)));
+  for (int b = 0; b < bandCount; b++) {
+    bands[b].firstTileRow = b * tileRows / bandCount;
+    bands[b].lastTileRow = (b + 1) * tileRows / bandCount;
+#if !LEAPFROG_STEP
+    bands[b].lineBuffer[0][0] = bands[b].lineBuffer[0][fieldWidth + 1] = 0;
+    bands[b].lineBuffer[1][0] = bands[b].lineBuffer[1][fieldWidth + 1] = 0;
+#endif
+  }
+  if (bandCount > 1) {
+    startBandWorkers();
+  } else {
+    stopBandWorkers();
+  }
+}
+
+/*
+ * Advances the simulation by one step, with each band stepped in parallel by its own worker, and fills in the image array if render is set.
+ * Produces exactly the same u, v, and image as stepFieldTwoPass(), whatever the number of bands.
+ * With LEAPFROG_STEP, the bands write the next values of u into v, which is then swapped with u.
+ */
+void stepFieldFused(bool render) {
+  renderStep = render;
+#if INTENSITY_AVERAGE
+  sampleIntensity = fieldView == INTENSITY_VIEW && loopCounter % intensitySampleInterval == 0;
+#endif
+  if (render && fieldView == SURFACE_VIEW && surfaceShadingScale != colorScale) {
+    buildSurfaceShading();
+  }
+#if FIELD_STATISTICS
+  measureStep = render && renderedStepCount++ % statisticsInterval == 0;
+#endif
+  if (bandCount == 1) {
+    captureBandHalos(&bands[0]);
+    stepBandForStep(&bands[0]);
+  } else {
+    runBands();
+  }
+#if LEAPFROG_STEP
+  // The stepped pixels of v now hold the next values of u, and u the previous ones
+  field_t *swap = u;
+  u = v;
+  v = swap;
+#endif
+  applyOpenBoundary(render);
+  applySources(render);
+  if (render && fieldImage != image) {
+    scaleUpImage();
+  }
+#if FIELD_STATISTICS
+  if (measureStep) {
+    gatherFieldStatistics();
+#if AUTO_GAIN
+    updateColorBitShift(); // For the next rendered step
+#endif
+  }
+#endif
+
+  updateActiveTiles();
+}
+
+#if LEAPFROG_STEP
+/*
+ * Advances the simulation by the given number of steps without rendering, giving exactly the same u and v as calling stepFieldFused(false)
+ * that many times and incrementing loopCounter after each, which it also does. Meant for fields much larger than the screen on a host build,
+ * where every plain step streams all of u, v, and pixelType in from main memory.
+ * Steps are taken TEMPORAL_BLOCK_STEPS at a time, in a single sweep down the rows: at each position of the sweep, step 1 is taken for one row,
+ * step 2 for the row above it, and so on, so each row is brought into the cache once for every TEMPORAL_BLOCK_STEPS steps.
+ * Step k of a row only needs step k - 1 of the rows either side, which is already done. The leapfrog step keeps steps k - 1 and k - 2
+ * in u and v, and writes step k over step k - 2; taking the steps at each position in order means that nothing is overwritten while
+ * it is still needed. OPEN_BOUNDARY pixels are stepped along with their inner neighbors, and SOURCE pixels along with their rows.
+ * Every tile is stepped, and all of them are left active, since tiles the step would have skipped stay zero either way.
+ * Runs on the calling thread only.
+ */
+void stepFieldBlocked(int steps) {
+  while (steps > 0) {
+    int blockSteps = std::min(steps, TEMPORAL_BLOCK_STEPS);
+    // Step k is written into levels[k & 1], which holds step k - 2; step 0 is in u, and the step before it in v
+    field_t *levels[2] = { u, v };
+    // Tables are in index order, so the next SOURCE pixel, and the next OPEN_BOUNDARY pixel by its inner neighbor, are tracked for each step
+    const SourcePixel *nextSource[TEMPORAL_BLOCK_STEPS + 1];
+    BoundaryPixel *nextBoundary[TEMPORAL_BLOCK_STEPS + 1];
+    for (int k = 1; k <= blockSteps; k++) {
+      nextSource[k] = sources;
+      nextBoundary[k] = boundary;
+    }
+
+    for (int position = 0; position < fieldHeight + blockSteps - 1; position++) {
+      for (int k = std::max(1, position - fieldHeight + 2); k <= std::min(blockSteps, position + 1); k++) {
+        int i = position - k + 1;
+        int rowStart = i * fieldStride;
+        const field_t *current = levels[(k - 1) & 1];
+        field_t *next = levels[k & 1];
+
+        for (const MaterialSpan *span = spans + rowFirstSpan[i]; span < spans + rowFirstSpan[i + 1]; span++) {
+          const field_t *centerRow = current + rowStart;
+          if (span->type == NORMAL_PIXEL) {
+            stepWaveSpan<NORMAL_PIXEL, false, AMPLITUDE_VIEW>(span->start, span->end, rowStart, centerRow - fieldStride, centerRow, centerRow + fieldStride, next + rowStart);
+          } else if (span->type == ABSORBANT_PIXEL) {
+            stepWaveSpan<ABSORBANT_PIXEL, false, AMPLITUDE_VIEW>(span->start, span->end, rowStart, centerRow - fieldStride, centerRow, centerRow + fieldStride, next + rowStart);
+          } else if (span->type == GLASS_PIXEL) {
+            stepWaveSpan<GLASS_PIXEL, false, AMPLITUDE_VIEW>(span->start, span->end, rowStart, centerRow - fieldStride, centerRow, centerRow + fieldStride, next + rowStart);
+          } else if (span->type == GRADED_PIXEL) {
+            stepGradedSpan<false, AMPLITUDE_VIEW>(span->start, span->end, rowStart, centerRow - fieldStride, centerRow, centerRow + fieldStride, next + rowStart);
+          }
+        }
+
+        // As in stepFieldFused(), OPEN_BOUNDARY pixels are set before SOURCE pixels
+        BoundaryPixel *pixel = nextBoundary[k];
+        for (; pixel < boundary + boundaryCount && (int)pixel->neighbor < rowStart + fieldStride; pixel++) {
+          next[pixel->index] = stepBoundaryPixel(pixel, next[pixel->neighbor], current[pixel->index]);
+        }
+        nextBoundary[k] = pixel;
+        const SourcePixel *source = nextSource[k];
+        for (; source < sources + sourceCount && (int)source->index < rowStart + fieldStride; source++) {
+          next[source->index] = sourceAmplitude(source->phaseOffset + (loopCounter + k - 1) * source->phaseIncrement);
+        }
+        nextSource[k] = source;
+      }
+    }
+
+    u = levels[blockSteps & 1];
+    v = levels[(blockSteps - 1) & 1];
+    loopCounter += blockSteps;
+    steps -= blockSteps;
+  }
+  activateAllTiles();
+}
+#endif
@@ -0,0 +1,389 @@
+#pragma once
+
+/*
+ * Wave field simulation: pixel types, modes, field arrays, and the step kernels that advance the wave equation.
+ * Nothing in here depends on the display or on Arduino, so the solver can also be built and checked on a Linux host.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Size of the screen, which is the size of the grid main.cpp asks setGridSize() for: 320 x 170 on the T-Display S3, or e.g. 240 x 135
+// or 480 x 222 on other LilyGO panels when built with -DWIDTH and -DHEIGHT. The solver itself only uses gridWidth and gridHeight.
+#ifndef WIDTH
+#define WIDTH 320
+#endif
+#ifndef HEIGHT
+#define HEIGHT 170
+#endif
+
+// Wave equation applies to pixels with pixelStatus values of NORMAL_PIXEL, ABSORBANT_PIXEL, GLASS_PIXEL
+#define NORMAL_PIXEL 0
+// ABSORBANT pixels have high damping on v
+#define ABSORBANT_PIXEL 1
+// GLASS pixels exhibit impedance by changing v less (with a lower proportionality constant)
+#define GLASS_PIXEL 2
+// WALL pixels stay fixed with zeroes in u and v, and a hardcoded 16-bit color value in image
+#define WALL_PIXEL 3
+// Remaining SOURCE types set u to various amplitudes
+#define LOW_FREQ_POS_SOURCE_PIXEL 4
+#define LOW_FREQ_NEG_SOURCE_PIXEL 5
+#define MID_FREQ_POS_SOURCE_PIXEL 6
+#define MID_FREQ_NEG_SOURCE_PIXEL 7
+#define HIGH_FREQ_POS_SOURCE_PIXEL 8
+#define HIGH_FREQ_NEG_SOURCE_PIXEL 9
+#define PHASED_ARRAY_SOURCE_PIXEL 10
+// GRADED pixels take their wave speed and damping from per-pixel coefficients (see setGradedPixel())
+#define GRADED_PIXEL 11
+// OPEN_BOUNDARY pixels sit along the edges of the field and let waves pass out through them instead of reflecting them (see applyOpenBoundary())
+#define OPEN_BOUNDARY_PIXEL 12
+
+#define IS_SOURCE_PIXEL(pixelStatus) ((pixelStatus) >= LOW_FREQ_POS_SOURCE_PIXEL && (pixelStatus) <= PHASED_ARRAY_SOURCE_PIXEL)
+
+// Just use a light gray for WALL pixels (can use 0xffff for garish white)
+#define WALL_COLOR (2048 | 64 | 2)
+
+// 0.1 creates waves with ~16 px half wavelength:
+#define RADIANS_PER_ITERATION 0.1
+
+// For phased array pixels only:
+#define RADIANS_PER_PIXEL 0.15
+
+// log2 of the number of entries in the sine table used for SOURCE pixel amplitudes
+#define SINE_TABLE_BITS 10
+
+// Shifting right 2 bits (i.e. division by 4) implies a refractive index of sqrt(4) = 2.0
+#define GLASS_REFRACTION_BIT_SHIFT 2
+
+// Fixed-point formats of the GRADED pixel coefficients: the square of the wave speed has 8 fractional bits (256 for NORMAL pixels,
+// 64 for GLASS), and the fraction of v lost to damping on each step has 16 (16 for NORMAL pixels, 2048 for ABSORBANT)
+#define WAVE_SPEED_SQUARED_BITS 8
+#define DAMPING_RATE_BITS 16
+#define NORMAL_WAVE_SPEED_SQUARED (1 << WAVE_SPEED_SQUARED_BITS)
+#define NORMAL_DAMPING_RATE (1 << (DAMPING_RATE_BITS - LOW_DAMPING_BIT_SHIFT))
+
+// 1 to store u and v as int16_t instead of int32_t, halving the memory they take up and the memory traffic of each step
+#define FIELD_INT16 0
+
+#if FIELD_INT16
+typedef int16_t field_t;
+// Intermediate results are calculated in 32 bits, so the whole INT16 range is available and capping amounts to saturating arithmetic
+#define MIN_RANGE -0x8000
+#define MAX_RANGE 0x7FFF
+// Shifting the magnitude of u right by this many bits gives a color intensity from 0 to 63
+#define COLOR_BIT_SHIFT 8
+// Shifting the magnitude of u right by this many bits before squaring it for FieldStatistics keeps the square within 32 bits
+#define STATISTICS_BIT_SHIFT 0
+#else
+typedef int32_t field_t;
+// Using only half the available INT32 range to guard against overflow after addition operations
+#define MIN_RANGE -0x40000000
+#define MAX_RANGE 0x3FFFFFFF
+// Shifting the magnitude of u right by this many bits gives a color intensity from 0 to 63
+#define COLOR_BIT_SHIFT 23
+// Shifting the magnitude of u right by this many bits before squaring it for FieldStatistics keeps the square within 32 bits
+#define STATISTICS_BIT_SHIFT 15
+#endif
+
+#define LOW_DAMPING_BIT_SHIFT 12
+#define HIGH_DAMPING_BIT_SHIFT 5
+
+// Speed of waves across NORMAL pixels, in pixels per step: the Laplacian is added to v at a quarter weight, so the speed is sqrt(1/4)
+#define WAVE_SPEED_PIXELS_PER_STEP 0.5
+
+// 1 to surround the *_ABSORBER_MODE variants with OPEN_BOUNDARY pixels; 0 for the original 15 pixel bands of ABSORBANT pixels
+#define OPEN_BOUNDARY 1
+
+// Coefficient (1 - c) / (1 + c) of the one-way wave equation applied at OPEN_BOUNDARY pixels, where c is WAVE_SPEED_PIXELS_PER_STEP, with 16 fractional bits
+#define OPEN_BOUNDARY_COEFFICIENT 21845
+
+// 1 to update v, u, and image in a single sweep over the grid; 0 to use the original two-pass loop. Can be set with -DFUSED_WAVE_STEP
+#ifndef FUSED_WAVE_STEP
+#define FUSED_WAVE_STEP 1
+#endif
+
+// 1 to keep the previous values of u in v instead of its rate of change, so each step reads u and writes v with no line buffers
+// or halos and then swaps the two; 0 for the explicit update of v then u. Needs FUSED_WAVE_STEP.
+// Can be set with -DLEAPFROG_STEP, which stepFieldBlocked() and ISOTROPIC_LAPLACIAN need
+#ifndef LEAPFROG_STEP
+#define LEAPFROG_STEP 0
+#endif
+#if LEAPFROG_STEP && !FUSED_WAVE_STEP
+#error LEAPFROG_STEP needs FUSED_WAVE_STEP
+#endif
+
+// 1 to use a nine point Laplacian, with the diagonal neighbors weighted so that the wave speed barely depends on direction,
+// which keeps circular waves round on a reduced resolution grid; 0 for the five point stencil. Needs LEAPFROG_STEP.
+// Can be set with -DISOTROPIC_LAPLACIAN
+#ifndef ISOTROPIC_LAPLACIAN
+#define ISOTROPIC_LAPLACIAN 0
+#endif
+#if ISOTROPIC_LAPLACIAN && !LEAPFROG_STEP
+#error ISOTROPIC_LAPLACIAN needs LEAPFROG_STEP
+#endif
+
+// Number of steps stepFieldBlocked() takes in each sweep down the rows of the field
+#define TEMPORAL_BLOCK_STEPS 8
+
+// 1 to skip tiles of the field that are entirely zero and cannot be disturbed during the next step; 0 to step every tile
+#define ACTIVE_TILE_TRACKING 1
+
+// 1 to step each mode with a version of the fused step compiled for just the materials it uses; 0 for the version handling every material.
+// Off by default, since it made no measurable difference on a host build (see README.md) and adds some 25 KB of code.
+// Can be set with -DSPECIALIZED_STEP, which tools/specialized_step.cpp uses to time the two against each other
+#ifndef SPECIALIZED_STEP
+#define SPECIALIZED_STEP 0
+#endif
+
+// 1 to gather the largest magnitude, the sum of squares, and a histogram of the magnitudes of u over the pixels stepped by each rendered step
+// (see FieldStatistics); 0 to skip them
+#define FIELD_STATISTICS 1
+
+// FieldStatistics are gathered on one rendered step in this many, spreading their cost; AUTO_GAIN moves the color shift by at most one bit each time
+#define STATISTICS_INTERVAL 4
+
+// 1 to pick the shift colorize() applies to u from the statistics of the last rendered step, so quiet modes are not left black and loud ones
+// do not saturate; 0 to always shift by COLOR_BIT_SHIFT. Needs FIELD_STATISTICS.
+#define AUTO_GAIN 1
+#if AUTO_GAIN && !FIELD_STATISTICS
+#error AUTO_GAIN needs FIELD_STATISTICS
+#endif
+
+// Fraction of the moving pixels, in percent, that AUTO_GAIN lets reach the top of the color scale
+#define AUTO_GAIN_PERCENTILE 1
+
+// AUTO_GAIN brightens quiet fields by at most this many bits over COLOR_BIT_SHIFT, so that leftover ripples are not blown up to full color
+#define AUTO_GAIN_MAX_BOOST_BITS 4
+
+// 1 to keep an exponential moving average of the square of u in a plane of uint16_t as the field is stepped, for the intensity view
+// (INTENSITY_VIEW) to draw in place of u; 0 to leave it out. Needs FUSED_WAVE_STEP, and is left out without it unless set with -D
+#ifndef INTENSITY_AVERAGE
+#define INTENSITY_AVERAGE FUSED_WAVE_STEP
+#endif
+#if INTENSITY_AVERAGE && !FUSED_WAVE_STEP
+#error INTENSITY_AVERAGE needs FUSED_WAVE_STEP
+#endif
+
+// The average is updated on one step in INTENSITY_SAMPLE_INTERVAL, which keeps down its cost; the interval is chosen so that successive
+// samples land well apart in the cycle of the square of u for each of the SOURCE frequencies, rather than creeping round it
+#define INTENSITY_SAMPLE_INTERVAL 13
+
+// Each update moves the average 1 / 2^INTENSITY_AVERAGE_BIT_SHIFT of the way towards the square of u, so it averages over about 104 steps,
+// nearly two periods of the SOURCE pixels (see RADIANS_PER_ITERATION)
+#define INTENSITY_AVERAGE_BIT_SHIFT 3
+
+// SURFACE_VIEW draws u as the height of a shaded surface, with the color for its slope looked up in a table of
+// 2^SURFACE_TABLE_BITS x 2^SURFACE_TABLE_BITS entries, one axis for each direction
+#define SURFACE_TABLE_BITS 5
+
+// 1 to step NORMAL, ABSORBANT, and GLASS spans with vector instructions where the target has them (SSE4.1 or AVX2 on a host build); 0 for the scalar loop only.
+// There is no vector implementation for the ESP32-S3 yet, which always uses the scalar loop.
+// Can be set with -DSIMD_STENCIL, which tools/stencil_check.cpp uses to build the two paths it compares
+#ifndef SIMD_STENCIL
+#define SIMD_STENCIL 1
+#endif
+
+// Number of horizontal bands the field is split into, each stepped in parallel by its own task pinned to a core (see startSolverBands())
+#define SOLVER_BANDS 2
+
+// Upper limit on the number of bands; only the ESP32-S3 is limited to its two cores
+#ifdef ESP_PLATFORM
+#define MAX_SOLVER_BANDS 2
+#else
+#define MAX_SOLVER_BANDS 16
+#endif
+
+// u, v, pixelType, and image each start on a FIELD_ALIGNMENT byte boundary in their arena, and the rows of u and v are padded
+// to a multiple of FIELD_ALIGNMENT bytes (see setGridSize()); 64 bytes is a cache line on the ESP32-S3 and on most hosts
+#define FIELD_ALIGNMENT 64
+
+// How the big buffers are placed in memory (see allocateBuffer()): PLANNED_PLACEMENT puts the ones every step reads and writes in
+// internal RAM while there is room and the rest in PSRAM, PSRAM_PLACEMENT puts all of them in PSRAM, and DEFAULT_PLACEMENT leaves it to malloc()
+#define PLANNED_PLACEMENT 0
+#define PSRAM_PLACEMENT 1
+#define DEFAULT_PLACEMENT 2
+
+#define TOTAL_PLACEMENT_COUNT 3
+
+// Internal RAM PLANNED_PLACEMENT leaves free for task stacks, the display driver, WiFi, and other small allocations
+#define INTERNAL_RAM_RESERVE 32768
+
+// Where a buffer ended up: internal RAM, PSRAM, or, on a host build, wherever malloc() put it
+#define INTERNAL_RAM 0
+#define EXTERNAL_RAM 1
+#define HOST_RAM 2
+
+// The field is divided into tiles of TILE_WIDTH x TILE_HEIGHT pixels for tracking which regions are active
+#define TILE_WIDTH 32
+#define TILE_HEIGHT 10
+
+#define TOUCH_ONLY_MODE 0
+#define RANDOM_POINTS_MODE 1
+#define RANDOM_POINTS_ABSORBER_MODE 2
+#define RANDOM_POINTS_MULTIFREQUENCY_MODE 3
+#define RANDOM_POINTS_MULTIFREQUENCY_ABSORBER_MODE 4
+#define MONOPOLE_MODE 5
+#define MONOPOLE_ABSORBER_MODE 6
+#define DIPOLE_MODE 7
+#define DIPOLE_ABSORBER_MODE 8
+#define QUADRUPOLE_MODE 9
+#define QUADRUPOLE_ABSORBER_MODE 10
+#define SUPERPOSITION_MODE 11
+#define FLAT_MIRROR_MODE 12
+#define PARABOLIC_MIRROR_MODE 13
+#define ELLIPTIC_MIRROR_MODE 14
+#define REFRACTION_MODE 15
+#define PRISM_MODE 16
+#define LENS_MODE 17
+#define PARTIAL_INTERNAL_REFLECTION_MODE 18
+#define TOTAL_INTERNAL_REFLECTION_MODE 19
+#define FIBER_OPTIC_MODE 20
+#define WAVEGUIDE_MODE 21
+#define PHASED_ARRAY_MODE 22
+#define DOUBLE_SLIT_DIFFRACTION_MODE 23
+#define DIFFRACTION_GRATING_MODE 24
+#define MAZE_MODE 25
+#define GRADED_INDEX_LENS_MODE 26
+
+#define TOTAL_MODES_COUNT 27
+
+#define RED_BLUE_SCALE 0
+#define YELLOW_PURPLE_SCALE 1
+#define RED_GREEN_SCALE 2
+#define YELLOW_CYAN_SCALE 3
+#define BLUE_GREEN_SCALE 4
+#define CYAN_PURPLE_SCALE 5
+// Scales from here on are drawn from gradients worked out at compile time (see colorGradients in wave_field.cpp)
+#define FIRE_ICE_SCALE 6
+
+#define FIXED_SCALE_COUNT 6
+#define TOTAL_SCALE_COUNT 7
+
+// Each hue of a color scale has 2^COLOR_LEVEL_BITS levels for the magnitude of u; 6 gives the 64 levels COLOR_BIT_SHIFT is set for,
+// and more give the gradients finer steps at the cost of bigger color tables (7 KB at 6 bits, 28 KB at 8)
+#define COLOR_LEVEL_BITS 6
+#define COLOR_LEVELS (1 << COLOR_LEVEL_BITS)
+
+// Classes of material with colors of their own in the color tables: NORMAL pixels and the like, the tinted ABSORBANT and GLASS pixels, and WALL pixels
+#define PLAIN_COLORS 0
+#define ABSORBANT_COLORS 1
+#define GLASS_COLORS 2
+#define WALL_COLORS 3
+#define TOTAL_COLOR_CLASS_COUNT 4
+
+// What the image shows (see setFieldView()): u itself, its time averaged intensity, or u as the height of a shaded surface
+#define AMPLITUDE_VIEW 0
+#define INTENSITY_VIEW 1
+#define SURFACE_VIEW 2
+
+#define TOTAL_VIEW_COUNT 3
+
+// A run of consecutive pixels of the same type within a row, from column start up to but not including column end
+struct MaterialSpan {
+  uint16_t start;
+  uint16_t end;
+  uint8_t type;
+};
+
+// A SOURCE pixel, whose value of u is set to a sine wave on every step; its phase is phaseOffset + loopCounter * phaseIncrement,
+// with a full turn being 2^32
+struct SourcePixel {
+  uint32_t index;
+  uint32_t phaseOffset;
+  uint32_t phaseIncrement;
+};
+
+// An OPEN_BOUNDARY pixel and the pixel next to it on the inside of the field, whose value of u at the end of the last step is kept in neighborU
+struct BoundaryPixel {
+  uint32_t index;
+  uint32_t neighbor;
+  field_t neighborU;
+};
+
+// A buffer allocated by allocateBuffer(), and the region of memory it was placed in
+struct BufferPlacement {
+  const char *name;
+  size_t bytes;
+  uint8_t region;
+};
+
+// Most buffers that can be in bufferPlacements at once
+#define MAX_BUFFER_PLACEMENTS 8
+
+// Number of buckets in the histogram of FieldStatistics, one for each possible number of significant bits in the magnitude of u
+#define AMPLITUDE_HISTOGRAM_BUCKETS 32
+
+// Statistics of u over the pixels stepped by a rendered step (NORMAL, ABSORBANT, GLASS, and GRADED pixels in active tiles), gathered
+// as the bands step them when FIELD_STATISTICS is set; pixels in inactive tiles are all zero
+struct FieldStatistics {
+  // Number of pixels measured
+  uint32_t pixelCount;
+  // Largest magnitude of u
+  int32_t maxAmplitude;
+  // Sum of the squares of the magnitudes of u, each shifted right by STATISTICS_BIT_SHIFT first
+  uint64_t sumOfSquares;
+  // Bucket b counts the pixels whose magnitude of u has b significant bits, i.e. lies from 2^(b - 1) up to 2^b, with zero in bucket 0
+  uint32_t histogram[AMPLITUDE_HISTOGRAM_BUCKETS];
+};
+
+// Array of current wave amplitudes and their first partial derivatives with respect to time
+extern field_t *u, *v;
+// Array indicating pixel types (NORMAL_PIXEL, WALL_PIXEL, ABSORBANT_PIXEL, GLASS_PIXEL, etc.)
+extern uint8_t *pixelType;
+// Array for a full-screen image, 16-bit color encoding, gridWidth pixels to a row with no padding; in the type arena, or the buffer
+// given by setImageBuffer()
+extern uint16_t *image;
+
+// Size of the grid in screen pixels, which the arrays above cover (see setGridSize())
+extern int gridWidth;
+extern int gridHeight;
+
+// Each cell of the simulated field covers fieldScale x fieldScale pixels of the screen (see setFieldScale())
+extern int fieldScale;
+extern int fieldWidth;
+extern int fieldHeight;
+// Distance between the starts of consecutive rows of u, v, pixelType, and the other per-cell arrays: fieldWidth, padded (see toIndex())
+extern int fieldStride;
+
+extern uint32_t loopCounter;
+extern uint8_t mode;
+extern uint8_t colorScale;
+// Shift colorize() applies to the magnitude of u, which is COLOR_BIT_SHIFT unless AUTO_GAIN has picked another one
+extern uint8_t colorBitShift;
+// Statistics of the last rendered step that gathered them (see FIELD_STATISTICS)
+extern FieldStatistics fieldStatistics;
+// Statistics are gathered on one rendered step in statisticsInterval, which starts out as STATISTICS_INTERVAL; 1 measures every rendered step
+extern uint8_t statisticsInterval;
+// The intensity average is updated on one step in intensitySampleInterval, which starts out as INTENSITY_SAMPLE_INTERVAL; 1 samples every step
+extern uint8_t intensitySampleInterval;
+// What the image shows, one of the *_VIEW values (see setFieldView())
+extern uint8_t fieldView;
+// Policy for placing the big buffers, one of the *_PLACEMENT values; takes effect on the next setGridSize()
+extern uint8_t placementPolicy;
+// The big buffers allocated so far and where each of them went, in the order they were allocated
+extern BufferPlacement bufferPlacements[MAX_BUFFER_PLACEMENTS];
+extern int bufferPlacementCount;
+// The buffer that made the last setGridSize() fail, with a NULL name if it succeeded
+extern BufferPlacement allocationFailure;
+// Name of the current mode, set by initializeField()
+extern char label[48];
+
+void setImageBuffer(uint16_t *buffer);
+bool setGridSize(int width, int height);
+int toIndex(int i, int j);
+void wakeTile(int i, int j);
+void setGradedPixel(int index, uint16_t waveSpeedSquared, uint16_t dampingRate);
+void openBoundary(bool north, bool east, bool south, bool west);
+void compileField();
+bool setFieldScale(int scale);
+void initializeField();
+void setVelocity(int i, int j, int32_t velocity);
+bool setFieldView(uint8_t view);
+#if !LEAPFROG_STEP
+void stepFieldTwoPass();
+#endif
+void stepFieldFused(bool render);
+#if LEAPFROG_STEP
+void stepFieldBlocked(int steps);
+#endif
+void startSolverBands(int count);
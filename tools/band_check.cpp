@@ -0,0 +1,123 @@
+/*
+ * Host-side check that the field steps the same in any number of bands (SOLVER_BANDS, startSolverBands() in wave_field.cpp), and
+ * measurement of how the step scales with them. Every mode is stepped from its initial condition in 1 band and then in each of
+ * BAND_COUNTS, at full and at half resolution, rendering one step in four as main.cpp would with several steps per frame. Hashes of u,
+ * v, and the image after every CHECK_INTERVAL steps are compared against those from 1 band, and the average time per step over all
+ * the modes is reported for each number of bands. The bands run as std::threads, so they only step in parallel with as many cores.
+ * Build and run it from the root of the repository:
+ *
+ *   g++ -O2 -std=c++17 -Isrc tools/band_check.cpp src/wave_field.cpp -o band_check -lpthread && ./band_check
+ *
+ * It exits with a non-zero status if any hash differs. Build it with -DLEAPFROG_STEP=1 as well, which steps the bands differently.
+ */
+#include "wave_field.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <thread>
+
+// Steps run in each mode, and the number of steps between hashes
+#define CHECK_STEPS 1000
+#define CHECK_INTERVAL 250
+
+// One step in this many is rendered
+#define RENDER_INTERVAL 4
+
+// Numbers of bands checked against 1 band
+static const int BAND_COUNTS[] = { 2, 3, 4, 8 };
+#define BAND_COUNT_TOTAL (int)(sizeof(BAND_COUNTS) / sizeof(BAND_COUNTS[0]))
+
+/*
+ * Returns a hash of the given field over the cells of the field.
+ */
+uint64_t hashField(const field_t *field, uint64_t hash) {
+  for (int i = 0; i < fieldHeight; i++) {
+    for (int j = 0; j < fieldWidth; j++) {
+      field_t value = field[toIndex(i, j)];
+      const uint8_t *bytes = (const uint8_t*)&value;
+      for (size_t k = 0; k < sizeof(field_t); k++) {
+        hash = (hash ^ bytes[k]) * 1099511628211ull;
+      }
+    }
+  }
+  return hash;
+}
+
+/*
+ * Returns hashes of u, v, and the image, in that order, in hashes.
+ */
+void hashState(uint64_t hashes[3]) {
+  hashes[0] = hashField(u, 1469598103934665603ull);
+  hashes[1] = hashField(v, 1469598103934665603ull);
+  hashes[2] = 1469598103934665603ull;
+  for (int index = 0; index < gridWidth * gridHeight; index++) {
+    hashes[2] = (hashes[2] ^ image[index]) * 1099511628211ull;
+  }
+}
+
+/*
+ * Steps the current mode CHECK_STEPS times from its initial condition in the bands already started, keeps the hashes of the state
+ * after every CHECK_INTERVAL steps, and returns the time spent stepping in seconds.
+ */
+double runMode(int m, uint64_t hashes[][3]) {
+  // RANDOM_POINTS modes place their sources with random(), so each run of a mode starts from the same seed
+  srand(m);
+  mode = m;
+  loopCounter = 0;
+  initializeField();
+  double seconds = 0;
+  for (int step = 1; step <= CHECK_STEPS; step++) {
+    auto start = std::chrono::steady_clock::now();
+    stepFieldFused(step % RENDER_INTERVAL == 0);
+    seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    loopCounter++;
+    if (step % CHECK_INTERVAL == 0) {
+      hashState(hashes[step / CHECK_INTERVAL - 1]);
+    }
+  }
+  return seconds;
+}
+
+int main() {
+  if (!setGridSize(WIDTH, HEIGHT)) {
+    fprintf(stderr, "Not enough memory for the field\n");
+    return 2;
+  }
+  printf("%d x %d field, %u hardware threads\n", WIDTH, HEIGHT, std::thread::hardware_concurrency());
+  const char *names[3] = { "u", "v", "image" };
+  int mismatches = 0;
+  int checks = 0;
+  for (int scale = 1; scale <= 2; scale++) {
+    setFieldScale(scale);
+    static uint64_t reference[TOTAL_MODES_COUNT][CHECK_STEPS / CHECK_INTERVAL][3];
+    startSolverBands(1);
+    double referenceSeconds = 0;
+    for (int m = 0; m < TOTAL_MODES_COUNT; m++) {
+      referenceSeconds += runMode(m, reference[m]);
+    }
+    printf("scale %d, %2d band%s: %6.3f ms/step\n", scale, 1, " ", 1000 * referenceSeconds / (TOTAL_MODES_COUNT * CHECK_STEPS));
+    for (int c = 0; c < BAND_COUNT_TOTAL; c++) {
+      startSolverBands(BAND_COUNTS[c]);
+      double seconds = 0;
+      for (int m = 0; m < TOTAL_MODES_COUNT; m++) {
+        uint64_t hashes[CHECK_STEPS / CHECK_INTERVAL][3];
+        seconds += runMode(m, hashes);
+        for (int check = 0; check < CHECK_STEPS / CHECK_INTERVAL; check++) {
+          for (int k = 0; k < 3; k++) {
+            checks++;
+            if (hashes[check][k] != reference[m][check][k]) {
+              printf("  scale %d mode %2d step %4d, %d bands: %s differs\n", scale, m, (check + 1) * CHECK_INTERVAL, BAND_COUNTS[c], names[k]);
+              mismatches++;
+            }
+          }
+        }
+      }
+      printf("scale %d, %2d bands: %6.3f ms/step, %.2fx 1 band\n", scale, BAND_COUNTS[c], 1000 * seconds / (TOTAL_MODES_COUNT * CHECK_STEPS),
+        referenceSeconds / seconds);
+    }
+  }
+  printf("%d checks, %d mismatches\n", checks, mismatches);
+  startSolverBands(1);
+  return mismatches != 0;
+}
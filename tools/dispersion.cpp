@@ -0,0 +1,127 @@
+/*
+ * Host-side measurement of the numerical dispersion of the Laplacian stencils (see ISOTROPIC_LAPLACIAN in wave_field.h).
+ *
+ * The first table is worked out from the dispersion relation of the leapfrog step, 4 sin^2(w / 2) = -L(k) / 4, for the five point
+ * stencil and for the nine point one, giving the error in wave speed along an axis and along a diagonal, and the difference between
+ * the two (the anisotropy that makes circular waves square off), for a range of wavelengths in pixels.
+ *
+ * The second table runs the stencil the solver was compiled with: a Gaussian pulse 3 screen pixels wide is released in the middle of
+ * TOUCH_ONLY_MODE at full and at half resolution, and the radius of the ring it sends out is measured along an axis and a diagonal.
+ * Build and run it once with each setting of ISOTROPIC_LAPLACIAN, which needs LEAPFROG_STEP, from the root of the repository:
+ *
+ *   g++ -O2 -std=c++17 -DLEAPFROG_STEP=1 -DISOTROPIC_LAPLACIAN=0 -Isrc tools/dispersion.cpp src/wave_field.cpp -o dispersion -lpthread && ./dispersion
+ *   g++ -O2 -std=c++17 -DLEAPFROG_STEP=1 -DISOTROPIC_LAPLACIAN=1 -Isrc tools/dispersion.cpp src/wave_field.cpp -o dispersion -lpthread && ./dispersion
+ */
+#include "wave_field.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Weight of the diagonal stencil in the nine point Laplacian, as rounded by oneThird() in wave_field.cpp
+#define DIAGONAL_WEIGHT (1.0 / 4 + 1.0 / 16 + 1.0 / 64 + 1.0 / 256)
+// Width of the pulse in screen pixels, and how far its ring travels before it is measured
+#define PULSE_WIDTH 3.0
+#define RING_RADIUS 60
+
+/*
+ * Returns the relative error in wave speed for a wave with the given wavelength in pixels travelling at the given angle to the x axis,
+ * with diagonalWeight 0 for the five point stencil.
+ */
+double speedError(double wavelength, double angle, double diagonalWeight) {
+  double k = 2 * M_PI / wavelength;
+  double kx = k * cos(angle);
+  double ky = k * sin(angle);
+  double fivePoint = 2 * cos(kx) + 2 * cos(ky) - 4;
+  double diagonal = (2 * cos(kx + ky) + 2 * cos(kx - ky) - 4) / 2;
+  double laplacian = (1 - diagonalWeight) * fivePoint + diagonalWeight * diagonal;
+  double omega = 2 * asin(sqrt(-laplacian / 16));
+  return omega / k / WAVE_SPEED_PIXELS_PER_STEP - 1;
+}
+
+/*
+ * Returns u at a point between cells by bilinear interpolation.
+ */
+double sampleField(double i, double j) {
+  int i0 = (int)floor(i);
+  int j0 = (int)floor(j);
+  double di = i - i0;
+  double dj = j - j0;
+  return (1 - di) * ((1 - dj) * u[toIndex(i0, j0)] + dj * u[toIndex(i0, j0 + 1)])
+    + di * ((1 - dj) * u[toIndex(i0 + 1, j0)] + dj * u[toIndex(i0 + 1, j0 + 1)]);
+}
+
+/*
+ * Returns the radius in cells of the highest point of the ring along the given angle from the middle of the field, to a fraction of a cell.
+ */
+double ringRadius(double angle) {
+  double bestRadius = 0;
+  double bestValue = 0;
+  for (double r = 2; r < fieldHeight / 2 - 2; r += 0.05) {
+    double value = sampleField(fieldHeight / 2 + r * sin(angle), fieldWidth / 2 + r * cos(angle));
+    if (value > bestValue) {
+      bestValue = value;
+      bestRadius = r;
+    }
+  }
+  // Bilinear interpolation peaks on whole cells, so fit a parabola through points one cell either side of the highest one
+  double before = sampleField(fieldHeight / 2 + (bestRadius - 1) * sin(angle), fieldWidth / 2 + (bestRadius - 1) * cos(angle));
+  double after = sampleField(fieldHeight / 2 + (bestRadius + 1) * sin(angle), fieldWidth / 2 + (bestRadius + 1) * cos(angle));
+  return bestRadius + (before - after) / (2 * (before - 2 * bestValue + after));
+}
+
+/*
+ * Releases the pulse at the given scale (see setFieldScale()) and prints the radius of its ring along an axis and a diagonal, in screen pixels.
+ */
+void measureRing(int scale) {
+  setFieldScale(scale);
+  mode = TOUCH_ONLY_MODE;
+  initializeField();
+  double width = PULSE_WIDTH / scale;
+  for (int i = 0; i < fieldHeight; i++) {
+    for (int j = 0; j < fieldWidth; j++) {
+      double di = i - fieldHeight / 2;
+      double dj = j - fieldWidth / 2;
+      double value = (MAX_RANGE >> 2) * exp(-(di * di + dj * dj) / (2 * width * width));
+      if (pixelType[toIndex(i, j)] == NORMAL_PIXEL && value >= 1) {
+        u[toIndex(i, j)] = (field_t)value;
+        // Released at rest: with LEAPFROG_STEP, v holds the previous values of u, otherwise its rate of change
+        v[toIndex(i, j)] = LEAPFROG_STEP ? (field_t)value : 0;
+        wakeTile(i, j);
+      }
+    }
+  }
+  int steps = (int)(RING_RADIUS / scale / WAVE_SPEED_PIXELS_PER_STEP);
+  for (int step = 0; step < steps; step++) {
+    stepFieldFused(false);
+  }
+  double axis = ringRadius(0) * scale;
+  double diagonal = ringRadius(M_PI / 4) * scale;
+  printf("%5d x %-3d %10.2f %10.2f %+10.2f\n", fieldWidth, fieldHeight, axis, diagonal, diagonal - axis);
+}
+
+int main() {
+  setGridSize(WIDTH, HEIGHT);
+
+  printf("Error in wave speed (%%), along an axis / along a diagonal / anisotropy\n");
+  printf("%10s %28s %28s\n", "wavelength", "five point", "nine point");
+  double wavelengths[] = { 3, 4, 6, 8, 12, 16, 24 };
+  double diagonalWeights[] = { 0, DIAGONAL_WEIGHT };
+  for (double wavelength : wavelengths) {
+    printf("%10.0f", wavelength);
+    for (double weight : diagonalWeights) {
+      double axis = speedError(wavelength, 0, weight) * 100;
+      double diagonal = speedError(wavelength, M_PI / 4, weight) * 100;
+      printf("  %+7.2f / %+7.2f / %6.2f", axis, diagonal, diagonal - axis);
+    }
+    printf("\n");
+  }
+
+  printf("\nRing from a %.0f pixel pulse after %d pixels, %s Laplacian (screen pixels)\n", PULSE_WIDTH, RING_RADIUS,
+    ISOTROPIC_LAPLACIAN ? "nine point" : "five point");
+  printf("%11s %10s %10s %10s\n", "field", "axis", "diagonal", "difference");
+  startSolverBands(1);
+  measureRing(1);
+  measureRing(2);
+  return 0;
+}
@@ -0,0 +1,106 @@
+/*
+ * Host-side check that the fused step (stepFieldFused(), FUSED_WAVE_STEP in wave_field.h) steps the field exactly as the original
+ * two-pass step (stepFieldTwoPass()) does. Every mode is stepped from its initial condition with each of them in turn, at full and at
+ * half resolution and in SOLVER_BANDS bands, rendering every step since the two-pass step always does, and hashes of u, v, and the image
+ * are compared after every CHECK_INTERVAL steps. The two-pass step only exists in the explicit form of the step, so this needs
+ * LEAPFROG_STEP 0. Build and run it from the root of the repository:
+ *
+ *   g++ -O2 -std=c++17 -Isrc tools/fused_check.cpp src/wave_field.cpp -o fused_check -lpthread && ./fused_check
+ *
+ * It exits with a non-zero status if any hash differs. Build it with FIELD_INT16 set to check the 16-bit fields.
+ */
+#include "wave_field.h"
+
+#if LEAPFROG_STEP
+#error tools/fused_check.cpp needs LEAPFROG_STEP 0, which has the two-pass step to compare against
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Steps run in each mode, and the number of steps between hashes
+#define CHECK_STEPS 1000
+#define CHECK_INTERVAL 250
+
+/*
+ * Returns a hash of the given field over the cells of the field.
+ */
+uint64_t hashField(const field_t *field, uint64_t hash) {
+  for (int i = 0; i < fieldHeight; i++) {
+    for (int j = 0; j < fieldWidth; j++) {
+      field_t value = field[toIndex(i, j)];
+      const uint8_t *bytes = (const uint8_t*)&value;
+      for (size_t k = 0; k < sizeof(field_t); k++) {
+        hash = (hash ^ bytes[k]) * 1099511628211ull;
+      }
+    }
+  }
+  return hash;
+}
+
+/*
+ * Returns hashes of u, v, and the image, in that order, in hashes.
+ */
+void hashState(uint64_t hashes[3]) {
+  hashes[0] = hashField(u, 1469598103934665603ull);
+  hashes[1] = hashField(v, 1469598103934665603ull);
+  hashes[2] = 1469598103934665603ull;
+  for (int index = 0; index < gridWidth * gridHeight; index++) {
+    hashes[2] = (hashes[2] ^ image[index]) * 1099511628211ull;
+  }
+}
+
+/*
+ * Steps the current mode CHECK_STEPS times from its initial condition with the fused step or the two-pass one, and keeps the hashes
+ * of the state after every CHECK_INTERVAL steps.
+ */
+void runMode(int m, bool fused, uint64_t hashes[][3]) {
+  // RANDOM_POINTS modes place their sources with random(), so each run of a mode starts from the same seed
+  srand(m);
+  mode = m;
+  loopCounter = 0;
+  initializeField();
+  for (int step = 1; step <= CHECK_STEPS; step++) {
+    if (fused) {
+      stepFieldFused(true);
+    } else {
+      stepFieldTwoPass();
+    }
+    loopCounter++;
+    if (step % CHECK_INTERVAL == 0) {
+      hashState(hashes[step / CHECK_INTERVAL - 1]);
+    }
+  }
+}
+
+int main() {
+  if (!setGridSize(WIDTH, HEIGHT)) {
+    fprintf(stderr, "Not enough memory for the field\n");
+    return 2;
+  }
+  startSolverBands(SOLVER_BANDS);
+  const char *names[3] = { "u", "v", "image" };
+  int mismatches = 0;
+  int checks = 0;
+  for (int scale = 1; scale <= 2; scale++) {
+    setFieldScale(scale);
+    for (int m = 0; m < TOTAL_MODES_COUNT; m++) {
+      uint64_t twoPass[CHECK_STEPS / CHECK_INTERVAL][3];
+      uint64_t fused[CHECK_STEPS / CHECK_INTERVAL][3];
+      runMode(m, false, twoPass);
+      runMode(m, true, fused);
+      for (int check = 0; check < CHECK_STEPS / CHECK_INTERVAL; check++) {
+        for (int k = 0; k < 3; k++) {
+          checks++;
+          if (twoPass[check][k] != fused[check][k]) {
+            printf("scale %d mode %2d step %4d: %s differs\n", scale, m, (check + 1) * CHECK_INTERVAL, names[k]);
+            mismatches++;
+          }
+        }
+      }
+    }
+  }
+  printf("%d checks, %d mismatches\n", checks, mismatches);
+  startSolverBands(1);
+  return mismatches != 0;
+}
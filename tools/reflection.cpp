@@ -0,0 +1,124 @@
+/*
+ * Host-side measurement of how much of a wave the edges of the field send back (see OPEN_BOUNDARY in wave_field.h).
+ *
+ * A Gaussian pulse is released in the middle of TOUCH_ONLY_MODE, with the edges of the field made into one of three boundaries: the plain
+ * WALL pixels of the modes without an absorber, the 15 pixel bands of ABSORBANT pixels of the *_ABSORBER_MODE variants with OPEN_BOUNDARY
+ * set to 0, and the OPEN_BOUNDARY pixels they have with it set to 1. The same pulse is also released in a field large enough that its ring
+ * never reaches an edge. Once the ring has run out past the edges of the small field, whatever is left inside it has come back from them,
+ * so the energy of the difference between the two fields there, over the energy of the whole ring in the large one, is the fraction
+ * reflected; the reflection coefficient is its square root, 0 for a perfect absorber, and a little under 1 for a wall since some of what
+ * it sends back is still in the outer pixels that are left out or has been damped. Energy is taken as the sum of u^2, which is only half of
+ * it, but the same half for both waves.
+ * Run it with two pulse widths, since the boundaries absorb long waves and short ones differently, from the root of the repository:
+ *
+ *   g++ -O2 -std=c++17 -Isrc tools/reflection.cpp src/wave_field.cpp -o reflection -lpthread && ./reflection
+ */
+#include "wave_field.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+// Width of the ABSORBANT bands of the *_ABSORBER_MODE variants with OPEN_BOUNDARY set to 0, as passed to clearField()
+#define ABSORBER_WIDTH 15
+// How much larger the reference field is on every side; the ring must not reach its edges within MEASURE_STEPS
+#define REFERENCE_MARGIN 400
+// Steps before the field is measured: long enough for the ring to run out past the corners of the WIDTH x HEIGHT field
+#define MEASURE_STEPS 440
+
+#define WALL_BOUNDARY 0
+#define ABSORBANT_BOUNDARY 1
+#define OPEN_BOUNDARY_PIXELS 2
+
+/*
+ * Makes the edges of the field, as set up by initializeField() for TOUCH_ONLY_MODE, into the given kind of boundary.
+ */
+void setBoundary(int boundary) {
+  if (boundary == ABSORBANT_BOUNDARY) {
+    for (int i = 1; i < fieldHeight - 1; i++) {
+      for (int j = 1; j < fieldWidth - 1; j++) {
+        if (i <= ABSORBER_WIDTH || j <= ABSORBER_WIDTH || i >= fieldHeight - ABSORBER_WIDTH - 1 || j >= fieldWidth - ABSORBER_WIDTH - 1) {
+          pixelType[toIndex(i, j)] = ABSORBANT_PIXEL;
+        }
+      }
+    }
+  } else if (boundary == OPEN_BOUNDARY_PIXELS) {
+    openBoundary(true, true, true, true);
+  }
+  compileField();
+}
+
+/*
+ * Releases a pulse of the given width in pixels at rest in the middle of the field, and steps it MEASURE_STEPS times.
+ */
+void runPulse(double width) {
+  for (int i = 0; i < fieldHeight; i++) {
+    for (int j = 0; j < fieldWidth; j++) {
+      double di = i - fieldHeight / 2;
+      double dj = j - fieldWidth / 2;
+      double value = (MAX_RANGE >> 2) * exp(-(di * di + dj * dj) / (2 * width * width));
+      if (pixelType[toIndex(i, j)] == NORMAL_PIXEL && value >= 1) {
+        u[toIndex(i, j)] = (field_t)value;
+        // Released at rest: with LEAPFROG_STEP, v holds the previous values of u, otherwise its rate of change
+        v[toIndex(i, j)] = LEAPFROG_STEP ? (field_t)value : 0;
+        wakeTile(i, j);
+      }
+    }
+  }
+  for (int step = 0; step < MEASURE_STEPS; step++) {
+    stepFieldFused(false);
+  }
+}
+
+/*
+ * Prints the reflection coefficient of each kind of boundary for a pulse of the given width, measured against the ring in the large field.
+ */
+void measureReflection(double width) {
+  // The ring in a field too large for it to reach an edge, kept for the WIDTH x HEIGHT window in the middle of it
+  setGridSize(WIDTH + 2 * REFERENCE_MARGIN, HEIGHT + 2 * REFERENCE_MARGIN);
+  startSolverBands(1);
+  mode = TOUCH_ONLY_MODE;
+  initializeField();
+  runPulse(width);
+  double incident = 0;
+  for (int i = 0; i < fieldHeight; i++) {
+    for (int j = 0; j < fieldWidth; j++) {
+      incident += (double)u[toIndex(i, j)] * u[toIndex(i, j)];
+    }
+  }
+  std::vector<double> reference(WIDTH * HEIGHT);
+  for (int i = 0; i < HEIGHT; i++) {
+    for (int j = 0; j < WIDTH; j++) {
+      reference[i * WIDTH + j] = u[toIndex(i + REFERENCE_MARGIN, j + REFERENCE_MARGIN)];
+    }
+  }
+
+  printf("%6.0f", width);
+  setGridSize(WIDTH, HEIGHT);
+  startSolverBands(1);
+  for (int boundary = WALL_BOUNDARY; boundary <= OPEN_BOUNDARY_PIXELS; boundary++) {
+    initializeField();
+    setBoundary(boundary);
+    runPulse(width);
+    // Measured inside the ABSORBANT bands whatever the boundary, so all three are compared over the same pixels
+    double reflected = 0;
+    for (int i = ABSORBER_WIDTH + 1; i < HEIGHT - ABSORBER_WIDTH - 1; i++) {
+      for (int j = ABSORBER_WIDTH + 1; j < WIDTH - ABSORBER_WIDTH - 1; j++) {
+        double difference = u[toIndex(i, j)] - reference[i * WIDTH + j];
+        reflected += difference * difference;
+      }
+    }
+    printf(" %14.4f", sqrt(reflected / incident));
+  }
+  printf("\n");
+}
+
+int main() {
+  printf("Reflection coefficient after %d steps, %d x %d field\n", MEASURE_STEPS, WIDTH, HEIGHT);
+  printf("%6s %14s %14s %14s\n", "pulse", "wall", "absorbant", "open");
+  printf("%6s %14s %14s %14s\n", "", "", "(OPEN_BND 0)", "(OPEN_BND 1)");
+  measureReflection(3);
+  measureReflection(6);
+  return 0;
+}
@@ -0,0 +1,112 @@
+/*
+ * Host-side timing of the versions of the fused step compiled for the materials each mode uses (SPECIALIZED_STEP in wave_field.h)
+ * against the version handling every material. Every mode is stepped from its initial condition BENCHMARK_STEPS times in one band,
+ * rendering one step in four as main.cpp would with several steps per frame, and the fastest of BENCHMARK_RUNS runs is kept, along with
+ * a hash of u, v, and the image at the end. Build it once as it is and once with SPECIALIZED_STEP set to 1, then give the second build
+ * the output of the first, from the root of the repository:
+ *
+ *   g++ -O2 -std=c++17 -march=native -Isrc tools/specialized_step.cpp src/wave_field.cpp -o step_general -lpthread
+ *   g++ -O2 -std=c++17 -march=native -DSPECIALIZED_STEP=1 -Isrc tools/specialized_step.cpp src/wave_field.cpp -o step_specialized -lpthread
+ *   ./step_general > step_general.txt && ./step_specialized step_general.txt
+ *
+ * The second build prints the time per step of each mode before and after, and exits with a non-zero status if any hash differs.
+ * On a busy host, run the pair a few times and go by the typical figures.
+ */
+#include "wave_field.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+
+// Steps per run, and number of runs of each mode, of which the fastest is kept
+#define BENCHMARK_STEPS 1500
+#define BENCHMARK_RUNS 5
+
+// One step in this many is rendered
+#define RENDER_INTERVAL 4
+
+/*
+ * Returns a hash of u and v over the field and of the image over the grid.
+ */
+uint64_t hashState() {
+  uint64_t hash = 1469598103934665603ull;
+  field_t *arrays[] = { u, v };
+  for (field_t *array : arrays) {
+    for (int i = 0; i < fieldHeight; i++) {
+      const uint8_t *bytes = (const uint8_t*)(array + toIndex(i, 0));
+      for (size_t k = 0; k < fieldWidth * sizeof(field_t); k++) {
+        hash = (hash ^ bytes[k]) * 1099511628211ull;
+      }
+    }
+  }
+  for (int index = 0; index < gridWidth * gridHeight; index++) {
+    hash = (hash ^ image[index]) * 1099511628211ull;
+  }
+  return hash;
+}
+
+/*
+ * Steps mode m BENCHMARK_STEPS times from its initial condition and returns the time per step in microseconds, leaving the hash of the
+ * result in hash.
+ */
+double runMode(int m, uint64_t *hash) {
+  // RANDOM_POINTS modes place their sources with random(), so each run of a mode starts from the same seed in both builds
+  srand(m);
+  mode = m;
+  loopCounter = 0;
+  initializeField();
+  auto start = std::chrono::steady_clock::now();
+  for (int step = 1; step <= BENCHMARK_STEPS; step++) {
+    stepFieldFused(step % RENDER_INTERVAL == 0);
+    loopCounter++;
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  *hash = hashState();
+  return 1e6 * seconds / BENCHMARK_STEPS;
+}
+
+int main(int argc, char **argv) {
+  FILE *reference = argc > 1 ? fopen(argv[1], "r") : NULL;
+  if (argc > 1 && reference == NULL) {
+    fprintf(stderr, "Cannot open %s\n", argv[1]);
+    return 2;
+  }
+  if (!setGridSize(WIDTH, HEIGHT)) {
+    fprintf(stderr, "Not enough memory for the field\n");
+    return 2;
+  }
+  startSolverBands(1);
+  int mismatches = 0;
+  double totalMicros = 0;
+  double totalReferenceMicros = 0;
+  for (int m = 0; m < TOTAL_MODES_COUNT; m++) {
+    double micros = 1e9;
+    uint64_t hash = 0;
+    for (int run = 0; run < BENCHMARK_RUNS; run++) {
+      micros = fmin(micros, runMode(m, &hash));
+    }
+    totalMicros += micros;
+    if (reference == NULL) {
+      printf("mode %2d %016llx %8.2f\n", m, (unsigned long long)hash, micros);
+      continue;
+    }
+    int referenceMode;
+    unsigned long long referenceHash;
+    double referenceMicros;
+    if (fscanf(reference, "mode %d %llx %lf\n", &referenceMode, &referenceHash, &referenceMicros) != 3 || referenceMode != m) {
+      fprintf(stderr, "%s does not list mode %d\n", argv[1], m);
+      return 2;
+    }
+    totalReferenceMicros += referenceMicros;
+    printf("mode %2d: %8.2f us/step, %8.2f us/step before, %+5.1f%%%s\n", m, micros, referenceMicros, 100 * (referenceMicros / micros - 1),
+      hash == referenceHash ? "" : "  MISMATCH");
+    mismatches += hash != referenceHash;
+  }
+  if (reference != NULL) {
+    printf("all modes: %8.2f us/step, %8.2f us/step before, %+5.1f%%, %d mismatches\n", totalMicros / TOTAL_MODES_COUNT,
+      totalReferenceMicros / TOTAL_MODES_COUNT, 100 * (totalReferenceMicros / totalMicros - 1), mismatches);
+  }
+  startSolverBands(1);
+  return mismatches != 0;
+}
@@ -0,0 +1,153 @@
+/*
+ * Host-side check and benchmark of stepFieldBlocked() against the same number of plain steps (stepFieldFused()). First every mode is
+ * stepped from its initial condition on a screen-sized grid, at full and at half resolution, and u and v are compared after each of
+ * CHECK_LENGTHS steps, which cover SOURCE, OPEN_BOUNDARY, GLASS, and GRADED pixels and sweeps cut short. Then square grids from 512 to
+ * 4096 pixels across are filled with waves, and both are checked again and their throughput reported in cell updates per second.
+ * Build and run it from the root of the repository:
+ *
+ *   g++ -O2 -std=c++17 -march=native -DLEAPFROG_STEP=1 -Isrc tools/temporal_blocking.cpp src/wave_field.cpp -o temporal_blocking -lpthread && ./temporal_blocking
+ */
+#include "wave_field.h"
+#if !LEAPFROG_STEP
+#error stepFieldBlocked() needs -DLEAPFROG_STEP=1
+#endif
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+
+// Steps per run, and number of runs of each kind, of which the fastest is reported
+#define BENCHMARK_STEPS 64
+#define BENCHMARK_RUNS 3
+
+// Numbers of steps after which the modes are compared, the last of them not a whole number of sweeps
+static const int CHECK_LENGTHS[] = { TEMPORAL_BLOCK_STEPS, 200, 403 };
+
+/*
+ * Resets the field to the touch-only mode, with every NORMAL pixel released at rest from a pattern of overlapping waves so that every tile is busy.
+ */
+void fillField() {
+  mode = TOUCH_ONLY_MODE;
+  initializeField();
+  for (int i = 0; i < fieldHeight; i++) {
+    for (int j = 0; j < fieldWidth; j++) {
+      if (pixelType[toIndex(i, j)] == NORMAL_PIXEL) {
+        field_t value = (field_t)((MAX_RANGE >> 3) * (sin(i * 0.21) * cos(j * 0.13) + sin((i + j) * 0.07)));
+        u[toIndex(i, j)] = value;
+        v[toIndex(i, j)] = value;
+        wakeTile(i, j);
+      }
+    }
+  }
+}
+
+/*
+ * Returns a hash of u and v.
+ */
+uint64_t hashField() {
+  uint64_t hash = 1469598103934665603ull;
+  field_t *arrays[] = { u, v };
+  for (field_t *array : arrays) {
+    const uint8_t *bytes = (const uint8_t*)array;
+    for (size_t k = 0; k < (size_t)fieldStride * fieldHeight * sizeof(field_t); k++) {
+      hash = (hash ^ bytes[k]) * 1099511628211ull;
+    }
+  }
+  return hash;
+}
+
+/*
+ * Steps every mode from its initial condition, plain and blocked, at full and at half resolution of a screen-sized grid, and returns the
+ * number of times u and v differ after one of CHECK_LENGTHS steps.
+ */
+int checkModes() {
+  if (!setGridSize(WIDTH, HEIGHT)) {
+    printf("%d x %d not enough memory\n", WIDTH, HEIGHT);
+    return 1;
+  }
+  int mismatches = 0;
+  int checks = 0;
+  for (int scale = 1; scale <= 2; scale++) {
+    setFieldScale(scale);
+    for (int m = 0; m < TOTAL_MODES_COUNT; m++) {
+      uint64_t hashes[2][sizeof(CHECK_LENGTHS) / sizeof(CHECK_LENGTHS[0])];
+      for (int blocked = 0; blocked < 2; blocked++) {
+        // RANDOM_POINTS modes place their sources with random(), so both runs of a mode start from the same seed
+        srand(m);
+        mode = m;
+        loopCounter = 0;
+        initializeField();
+        int steps = 0;
+        for (size_t check = 0; check < sizeof(CHECK_LENGTHS) / sizeof(CHECK_LENGTHS[0]); check++) {
+          if (blocked) {
+            stepFieldBlocked(CHECK_LENGTHS[check] - steps);
+          } else {
+            for (int step = steps; step < CHECK_LENGTHS[check]; step++) {
+              stepFieldFused(false);
+              loopCounter++;
+            }
+          }
+          steps = CHECK_LENGTHS[check];
+          hashes[blocked][check] = hashField();
+        }
+      }
+      for (size_t check = 0; check < sizeof(CHECK_LENGTHS) / sizeof(CHECK_LENGTHS[0]); check++) {
+        checks++;
+        if (hashes[0][check] != hashes[1][check]) {
+          printf("scale %d mode %2d after %3d steps: MISMATCH\n", scale, m, CHECK_LENGTHS[check]);
+          mismatches++;
+        }
+      }
+    }
+  }
+  printf("%d x %d, every mode at scales 1 and 2: %d checks, %d mismatches\n", WIDTH, HEIGHT, checks, mismatches);
+  setFieldScale(1);
+  return mismatches;
+}
+
+/*
+ * Runs BENCHMARK_STEPS steps from a freshly filled field, plain or blocked, and returns the time taken in seconds, leaving the hash of the result in hash.
+ */
+double runSteps(bool blocked, uint64_t *hash) {
+  fillField();
+  auto start = std::chrono::steady_clock::now();
+  if (blocked) {
+    stepFieldBlocked(BENCHMARK_STEPS);
+  } else {
+    for (int step = 0; step < BENCHMARK_STEPS; step++) {
+      stepFieldFused(false);
+      loopCounter++;
+    }
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  *hash = hashField();
+  return seconds;
+}
+
+int main() {
+  startSolverBands(1);
+  int sizes[] = { 512, 1024, 2048, 4096 };
+  int mismatches = checkModes();
+  for (int size : sizes) {
+    if (!setGridSize(size, size)) {
+      printf("%5d x %-5d not enough memory\n", size, size);
+      continue;
+    }
+    double plainSeconds = 1e9;
+    double blockedSeconds = 1e9;
+    uint64_t plainHash = 0;
+    uint64_t blockedHash = 0;
+    for (int run = 0; run < BENCHMARK_RUNS; run++) {
+      plainSeconds = fmin(plainSeconds, runSteps(false, &plainHash));
+      blockedSeconds = fmin(blockedSeconds, runSteps(true, &blockedHash));
+    }
+    double cellUpdates = (double)size * size * BENCHMARK_STEPS;
+    printf("%5d x %-5d plain %7.1f Mcell/s, blocked (%d steps per sweep) %7.1f Mcell/s, %.2fx, %s\n", size, size,
+      cellUpdates / plainSeconds / 1e6, TEMPORAL_BLOCK_STEPS, cellUpdates / blockedSeconds / 1e6, plainSeconds / blockedSeconds,
+      plainHash == blockedHash ? "identical" : "MISMATCH");
+    mismatches += plainHash != blockedHash;
+  }
+  return mismatches != 0;
+}